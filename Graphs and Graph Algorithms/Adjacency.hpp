@@ -0,0 +1,94 @@
+#ifndef ADJACENCY_HPP
+#define ADJACENCY_HPP
+
+/** @file Adjacency.hpp
+ * @brief Compressed adjacency snapshot of a Graph.
+ *
+ * Algorithms that sweep the whole graph many times read the neighbors of
+ * node i from two flat arrays instead of walking the Graph's edge sets
+ * through proxies. The snapshot is indexed by node index and edge index,
+ * and does not follow later changes to the Graph.
+ */
+
+#include <vector>
+
+/** Adjacency lists of a graph in compressed sparse row form.
+ * RI: offsets.size() == num_nodes() + 1, offsets[0] == 0
+ * RI: The neighbors of node i are targets[offsets[i]] ...
+ * 	targets[offsets[i+1] - 1], and edges[k] is the index of the Graph edge
+ * 	that leads to targets[k].
+ */
+struct Adjacency {
+	std::vector<int> offsets;
+	std::vector<int> targets;
+	std::vector<int> edges;
+
+	Adjacency() : offsets(1, 0) {
+	}
+
+	std::size_t num_nodes() const {
+		return offsets.size() - 1;
+	}
+
+	// Returns the number of adjacency entries
+	std::size_t size() const {
+		return targets.size();
+	}
+
+	int degree(int i) const {
+		return offsets[i + 1] - offsets[i];
+	}
+
+	// Range of adjacency entries of node i
+	int begin(int i) const {
+		return offsets[i];
+	}
+
+	int end(int i) const {
+		return offsets[i + 1];
+	}
+};
+
+/** Builds the adjacency of @a g from the edges that node.edge_begin() visits.
+ * @returns For an undirected graph, every incident edge of each node. For
+ * 	a directed graph, the outgoing edges of each node.
+ */
+template <typename G>
+Adjacency out_adjacency(G& g) {
+	Adjacency adj;
+	adj.offsets.reserve(g.num_nodes() + 1);
+	for(auto it = g.node_begin(); it != g.node_end(); ++it) {
+		auto n = *it;
+		for(auto jt = n.edge_begin(); jt != n.edge_end(); ++jt) {
+			auto e = *jt;
+			auto other = e.node2();
+			if( other == n )
+				other = e.node1();
+			adj.targets.push_back(other.index());
+			adj.edges.push_back(e.index());
+		}
+		adj.offsets.push_back(adj.targets.size());
+	}
+	return adj;
+}
+
+/** Builds the incoming adjacency of a directed graph @a g.
+ * The neighbors of node i are the sources of the edges that point to i.
+ */
+template <typename G>
+Adjacency in_adjacency(G& g) {
+	Adjacency adj;
+	adj.offsets.reserve(g.num_nodes() + 1);
+	for(auto it = g.node_begin(); it != g.node_end(); ++it) {
+		auto n = *it;
+		for(auto jt = n.incoming_edge_begin(); jt != n.incoming_edge_end(); ++jt) {
+			auto e = *jt;
+			adj.targets.push_back(e.node1().index());
+			adj.edges.push_back(e.index());
+		}
+		adj.offsets.push_back(adj.targets.size());
+	}
+	return adj;
+}
+
+#endif
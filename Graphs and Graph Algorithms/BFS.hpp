@@ -0,0 +1,280 @@
+#ifndef BFS_HPP
+#define BFS_HPP
+
+/** @file BFS.hpp
+ * @brief Parallel direction-optimizing breadth-first search.
+ *
+ * Each level is expanded either top-down, where the frontier nodes claim
+ * their unvisited neighbors, or bottom-up, where every unvisited node
+ * looks for a parent in the frontier and stops at the first one found.
+ * Top-down is cheap while the frontier is small; bottom-up wins once the
+ * frontier holds a large share of the remaining edges, since most
+ * unvisited nodes then find a parent after a few checks. The switch
+ * follows Beamer, Asanovic and Patterson: go bottom-up when the frontier's
+ * edges exceed the unexplored edges / alpha, and back to top-down when the
+ * frontier shrinks below n / beta nodes.
+ *
+ * Frontiers and the visited set are bitmaps of 64-bit words. Bottom-up
+ * levels split the nodes into chunks of whole words, so every word is
+ * written by one thread; top-down levels claim nodes with an atomic
+ * fetch_or.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+
+/** Output of a breadth-first search, by node index.
+ * RI: depth[i] == -1 and parent[i] == -1 iff node i was not reached
+ * RI: parent[source] == source
+ */
+struct BFSResult {
+	std::vector<int> depth;   //< Hop distance from the source
+	std::vector<int> parent;  //< Node before i on a shortest hop path
+};
+
+/** Set of node indices stored as bits, safe to update concurrently. */
+class Bitmap {
+	public:
+
+	void reset(std::size_t n) {
+		num_words_ = (n + 63) / 64;
+		words_.reset(new std::atomic<uint64_t>[num_words_]);
+		clear();
+	}
+
+	void clear() {
+		for(std::size_t k = 0; k < num_words_; ++k)
+			words_[k].store(0, std::memory_order_relaxed);
+	}
+
+	std::size_t num_words() const {
+		return num_words_;
+	}
+
+	bool test(std::size_t i) const {
+		return (words_[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1;
+	}
+
+	// Sets bit @a i; returns true if this call changed it
+	bool set_atomic(std::size_t i) {
+		uint64_t bit = uint64_t(1) << (i % 64);
+		return !(words_[i / 64].fetch_or(bit, std::memory_order_relaxed) & bit);
+	}
+
+	uint64_t word(std::size_t k) const {
+		return words_[k].load(std::memory_order_relaxed);
+	}
+
+	// Replaces word @a k. @pre No other thread writes word k.
+	void set_word(std::size_t k, uint64_t w) {
+		words_[k].store(w, std::memory_order_relaxed);
+	}
+
+	void swap(Bitmap& other) {
+		words_.swap(other.words_);
+		std::swap(num_words_, other.num_words_);
+	}
+
+	private:
+	std::unique_ptr<std::atomic<uint64_t>[]> words_;
+	std::size_t num_words_ = 0;
+};
+
+/** Direction-optimizing BFS over a fixed Adjacency.
+ * For an undirected graph, pass out_adjacency(g) twice; for a directed
+ * graph, pass out_adjacency(g) and in_adjacency(g).
+ */
+class DirectionOptimizingBFS {
+	public:
+
+	/** @param[in] alpha Go bottom-up when frontier edges > unexplored / alpha
+	 * @param[in] beta  Go top-down when frontier nodes < n / beta
+	 */
+	DirectionOptimizingBFS(const Adjacency& out, const Adjacency& in,
+						   int alpha = 15, int beta = 18)
+			: out_(out), in_(in), alpha_(alpha), beta_(beta),
+			  top_down_levels_(0), bottom_up_levels_(0) {
+	}
+
+	// Searches from @a source into @a result
+	void run(int source, BFSResult& result) {
+		std::size_t n = out_.num_nodes();
+		unsigned threads = num_threads();
+		result.depth.assign(n, -1);
+		result.parent.assign(n, -1);
+		visited_.reset(n);
+		frontier_bits_.reset(n);
+		next_bits_.reset(n);
+		next_.resize(threads);
+		top_down_levels_ = bottom_up_levels_ = 0;
+
+		result.depth[source] = 0;
+		result.parent[source] = source;
+		visited_.set_atomic(source);
+		frontier_.assign(1, source);
+		frontier_size_ = 1;
+
+		int64_t unexplored = out_.size();
+		int64_t frontier_edges = out_.degree(source);
+		bool bottom_up = false;
+		for(int level = 1; ; ++level) {
+			if( !bottom_up && frontier_edges > unexplored / alpha_ ) {
+				bottom_up = true;
+				to_bits_();
+			} else if( bottom_up && frontier_size_ < n / beta_ ) {
+				bottom_up = false;
+				to_queue_();
+			}
+			unexplored -= frontier_edges;
+			if( bottom_up ) {
+				++bottom_up_levels_;
+				frontier_edges = bottom_up_step_(level, result);
+			} else {
+				++top_down_levels_;
+				frontier_edges = top_down_step_(level, result);
+			}
+			if( frontier_size_ == 0 )
+				break;
+		}
+	}
+
+	BFSResult run(int source) {
+		BFSResult result;
+		run(source, result);
+		return result;
+	}
+
+	// Number of levels expanded in each direction by the last run
+	int top_down_levels() const {
+		return top_down_levels_;
+	}
+
+	int bottom_up_levels() const {
+		return bottom_up_levels_;
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	const Adjacency& out_;
+	const Adjacency& in_;
+	int alpha_;
+	int beta_;
+	int top_down_levels_;
+	int bottom_up_levels_;
+
+	Bitmap visited_;
+	// The frontier is a queue while top-down and a bitmap while bottom-up
+	std::vector<int> frontier_;
+	Bitmap frontier_bits_;
+	Bitmap next_bits_;
+	std::size_t frontier_size_;
+	// Next frontier found by each thread while top-down
+	std::vector<std::vector<int> > next_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	// Expands the frontier queue; returns the edges of the next frontier
+	int64_t top_down_step_(int level, BFSResult& result) {
+		std::vector<int64_t> edges(next_.size(), 0);
+		parallel_for_chunks(0, frontier_.size(),
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			std::vector<int>& next = next_[w];
+			for(std::size_t k = b; k < e; ++k) {
+				int u = frontier_[k];
+				for(int j = out_.begin(u); j < out_.end(u); ++j) {
+					int v = out_.targets[j];
+					if( !visited_.test(v) && visited_.set_atomic(v) ) {
+						result.depth[v] = level;
+						result.parent[v] = u;
+						next.push_back(v);
+						edges[w] += out_.degree(v);
+					}
+				}
+			}
+		}, 64);
+		frontier_.clear();
+		int64_t total = 0;
+		for(std::size_t w = 0; w < next_.size(); ++w) {
+			frontier_.insert(frontier_.end(), next_[w].begin(), next_[w].end());
+			next_[w].clear();
+			total += edges[w];
+		}
+		frontier_size_ = frontier_.size();
+		return total;
+	}
+
+	// Lets every unvisited node look for a parent in the frontier bitmap;
+	// returns the edges of the next frontier
+	int64_t bottom_up_step_(int level, BFSResult& result) {
+		std::size_t n = out_.num_nodes();
+		std::vector<int64_t> edges(next_.size(), 0);
+		std::vector<std::size_t> found(next_.size(), 0);
+		parallel_for_chunks(0, visited_.num_words(),
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			for(std::size_t k = b; k < e; ++k) {
+				uint64_t seen = visited_.word(k);
+				uint64_t next = 0;
+				std::size_t last = std::min(64 * k + 64, n);
+				for(std::size_t v = 64 * k; v < last; ++v) {
+					uint64_t bit = uint64_t(1) << (v % 64);
+					if( seen & bit )
+						continue;
+					for(int j = in_.begin(v); j < in_.end(v); ++j) {
+						int u = in_.targets[j];
+						if( frontier_bits_.test(u) ) {
+							result.depth[v] = level;
+							result.parent[v] = u;
+							next |= bit;
+							edges[w] += out_.degree(v);
+							++found[w];
+							break;
+						}
+					}
+				}
+				next_bits_.set_word(k, next);
+				visited_.set_word(k, seen | next);
+			}
+		}, 16);
+		frontier_bits_.swap(next_bits_);
+		int64_t total = 0;
+		frontier_size_ = 0;
+		for(std::size_t w = 0; w < next_.size(); ++w) {
+			total += edges[w];
+			frontier_size_ += found[w];
+		}
+		return total;
+	}
+
+	// Converts the frontier queue to a bitmap
+	void to_bits_() {
+		frontier_bits_.clear();
+		for(std::size_t k = 0; k < frontier_.size(); ++k)
+			frontier_bits_.set_atomic(frontier_[k]);
+		frontier_size_ = frontier_.size();
+	}
+
+	// Converts the frontier bitmap to a queue
+	void to_queue_() {
+		frontier_.clear();
+		for(std::size_t k = 0; k < frontier_bits_.num_words(); ++k) {
+			uint64_t word = frontier_bits_.word(k);
+			for(int bit = 0; word; ++bit, word >>= 1)
+				if( word & 1 )
+					frontier_.push_back(64 * k + bit);
+		}
+		frontier_size_ = frontier_.size();
+	}
+};
+
+#endif
@@ -61,7 +61,7 @@ struct PoissonColor {
 struct DefaultPosition {
   template <typename NODE>
   Point operator()(const NODE& node) {
-    return node.position();
+    return Point(node.position());
   }
 };
 
@@ -0,0 +1,330 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+/** @file Checkpoint.hpp
+ * @brief Binary checkpoints of a mass-spring simulation.
+ *
+ * A checkpoint holds everything needed to resume a run: the graph as it is
+ * after any removals (positions, velocities, masses, edges and their rest
+ * lengths), the simulation time and step, and the integrator's state.
+ *
+ * checkpoint_image() copies the state into a buffer on the simulation
+ * thread; a CheckpointWriter then writes the buffer from a background
+ * thread, so the simulation only pays for the copy. CheckpointFile maps a
+ * checkpoint into memory and rebuilds the graph straight from the mapping.
+ *
+ * File layout, every section aligned to 8 bytes:
+ * 	CheckpointHeader
+ * 	positions[num_nodes]     point_type
+ * 	velocities[num_nodes]    point_type
+ * 	masses[num_nodes]        scalar
+ * 	endpoints[2 * num_edges] int32_t node indices
+ * 	rest[num_edges]          scalar
+ * 	state[num_state]         point_type, integrator specific
+ */
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct CheckpointHeader {
+	char magic[8];          //< "CS207CKP"
+	uint32_t version;
+	uint32_t scalar_bytes;  //< sizeof(scalar) of the simulation
+	uint64_t num_nodes;
+	uint64_t num_edges;
+	uint64_t num_state;     //< Number of integrator state points
+	uint64_t step;
+	double time;
+	char integrator[32];    //< Name of the integrator that wrote the state
+};
+
+// Rounds @a n up to a multiple of 8.
+inline std::size_t checkpoint_align_(std::size_t n) {
+	return (n + 7) & ~std::size_t(7);
+}
+
+/** Byte offsets of the sections of a checkpoint. */
+struct CheckpointLayout {
+	std::size_t positions, velocities, masses, endpoints, rest, state, size;
+
+	CheckpointLayout(const CheckpointHeader& h, std::size_t point_bytes) {
+		std::size_t n = h.num_nodes, m = h.num_edges;
+		positions = checkpoint_align_(sizeof(CheckpointHeader));
+		velocities = checkpoint_align_(positions + n * point_bytes);
+		masses = checkpoint_align_(velocities + n * point_bytes);
+		endpoints = checkpoint_align_(masses + n * h.scalar_bytes);
+		rest = checkpoint_align_(endpoints + 2 * m * sizeof(int32_t));
+		state = checkpoint_align_(rest + m * h.scalar_bytes);
+		size = state + h.num_state * point_bytes;
+	}
+};
+
+/** Copies the simulation state into a checkpoint image.
+ * @param[in] g          Graph; G::node_value_type has a velocity and a mass
+ * 	and G::edge_value_type is the rest length
+ * @param[in] t          Simulation time
+ * @param[in] step       Number of steps taken
+ * @param[in] integrator Name of the integrator
+ * @param[in] state      Integrator state to resume with
+ */
+template <typename G>
+std::vector<char> checkpoint_image(G& g, double t, std::size_t step,
+								   const std::string& integrator,
+								   const std::vector<typename G::point_type>& state) {
+	typedef typename G::point_type point_type;
+	typedef typename point_type::value_type scalar;
+
+	CheckpointHeader h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, "CS207CKP", 8);
+	h.version = 1;
+	h.scalar_bytes = sizeof(scalar);
+	h.num_nodes = g.num_nodes();
+	h.num_edges = g.num_edges();
+	h.num_state = state.size();
+	h.step = step;
+	h.time = t;
+	std::strncpy(h.integrator, integrator.c_str(), sizeof(h.integrator) - 1);
+
+	CheckpointLayout layout(h, sizeof(point_type));
+	std::vector<char> image(layout.size, 0);
+	std::memcpy(&image[0], &h, sizeof(h));
+	point_type* x = (point_type*) &image[layout.positions];
+	point_type* v = (point_type*) &image[layout.velocities];
+	scalar* mass = (scalar*) &image[layout.masses];
+	for(auto it = g.node_begin(); it != g.node_end(); ++it) {
+		auto n = *it;
+		int i = n.index();
+		x[i] = n.position();
+		v[i] = n.value().velocity;
+		mass[i] = n.value().mass;
+	}
+	int32_t* ends = (int32_t*) &image[layout.endpoints];
+	scalar* rest = (scalar*) &image[layout.rest];
+	for(auto it = g.edge_begin(); it != g.edge_end(); ++it) {
+		auto e = *it;
+		int k = e.index();
+		ends[2 * k] = e.node1().index();
+		ends[2 * k + 1] = e.node2().index();
+		rest[k] = e.value();
+	}
+	if( !state.empty() )
+		std::memcpy(&image[layout.state], &state[0],
+					state.size() * sizeof(point_type));
+	return image;
+}
+
+/** Writes checkpoint images from a background thread.
+ * Each image is written to "path.tmp" and renamed over "path", so a crash
+ * mid-write leaves the previous checkpoint intact. If images arrive faster
+ * than they can be written, only the newest waiting image is kept.
+ */
+class CheckpointWriter {
+	public:
+
+	CheckpointWriter() : busy_(false), stop_(false),
+						 thread_(&CheckpointWriter::loop_, this) {
+	}
+
+	~CheckpointWriter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		thread_.join();
+	}
+
+	// Queues @a image to be written to @a path. Returns immediately.
+	void write(const std::string& path, std::vector<char>& image) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			path_ = path;
+			pending_.swap(image);
+			busy_ = true;
+		}
+		image.clear();
+		wake_.notify_all();
+	}
+
+	// Blocks until every queued image has been written.
+	void flush() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		idle_.wait(lock, [this] { return !busy_; });
+	}
+
+	private:
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable idle_;
+	std::string path_;
+	std::vector<char> pending_;
+	bool busy_;
+	bool stop_;
+	std::thread thread_;
+
+	void loop_() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(1) {
+			wake_.wait(lock, [this] { return stop_ || busy_; });
+			if( !busy_ && stop_ )
+				return;
+			std::vector<char> image;
+			image.swap(pending_);
+			std::string path = path_;
+			lock.unlock();
+			write_file_(path, image);
+			lock.lock();
+			if( pending_.empty() ) {
+				busy_ = false;
+				idle_.notify_all();
+			}
+		}
+	}
+
+	static void write_file_(const std::string& path,
+							const std::vector<char>& image) {
+		std::string tmp = path + ".tmp";
+		FILE* f = std::fopen(tmp.c_str(), "wb");
+		if( f == NULL ) {
+			std::cerr << "checkpoint: cannot open " << tmp << std::endl;
+			return;
+		}
+		bool ok = std::fwrite(&image[0], 1, image.size(), f) == image.size();
+		ok = (std::fclose(f) == 0) && ok;
+		if( !ok || std::rename(tmp.c_str(), path.c_str()) != 0 )
+			std::cerr << "checkpoint: failed to write " << path << std::endl;
+	}
+};
+
+/** A checkpoint file mapped read-only into memory. */
+class CheckpointFile {
+	public:
+
+	CheckpointFile() : data_(NULL), size_(0) {
+	}
+
+	~CheckpointFile() {
+		close();
+	}
+
+	/** Maps the checkpoint at @a path.
+	 * @returns false, with a message on std::cerr, if the file cannot be
+	 * 	mapped or is not a checkpoint written with @a point_bytes points,
+	 * 	including a truncated file or an edge whose nodes are out of range.
+	 */
+	bool open(const std::string& path, std::size_t point_bytes) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if( fd < 0 || fstat(fd, &st) != 0 ) {
+			std::cerr << "checkpoint: cannot open " << path << std::endl;
+			if( fd >= 0 )
+				::close(fd);
+			return false;
+		}
+		size_ = st.st_size;
+		void* p = size_ ? mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0)
+						: MAP_FAILED;
+		::close(fd);
+		if( p == MAP_FAILED ) {
+			std::cerr << "checkpoint: cannot map " << path << std::endl;
+			size_ = 0;
+			return false;
+		}
+		data_ = (const char*) p;
+		if( size_ < sizeof(CheckpointHeader) ||
+			std::memcmp(header().magic, "CS207CKP", 8) != 0 ||
+			header().version != 1 ||
+			header().scalar_bytes * 3 != point_bytes ||
+			!sections_fit_(point_bytes) || !endpoints_valid_(point_bytes) ) {
+			std::cerr << "checkpoint: " << path << " is not a compatible "
+					  << "checkpoint" << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		if( data_ )
+			munmap((void*) data_, size_);
+		data_ = NULL;
+		size_ = 0;
+	}
+
+	const CheckpointHeader& header() const {
+		return *(const CheckpointHeader*) data_;
+	}
+
+	/** Rebuilds the checkpointed graph into the empty graph @a g.
+	 * @param[out] state Integrator state saved with the checkpoint
+	 * @pre g.num_nodes() == 0
+	 * @post Node and edge indices match the checkpointed graph
+	 */
+	template <typename G>
+	void restore(G& g, std::vector<typename G::point_type>& state) const {
+		typedef typename G::point_type point_type;
+		typedef typename point_type::value_type scalar;
+		const CheckpointHeader& h = header();
+		CheckpointLayout layout(h, sizeof(point_type));
+		const point_type* x = (const point_type*) (data_ + layout.positions);
+		const point_type* v = (const point_type*) (data_ + layout.velocities);
+		const scalar* mass = (const scalar*) (data_ + layout.masses);
+		std::vector<typename G::node_type> nodes;
+		nodes.reserve(h.num_nodes);
+		for(std::size_t i = 0; i < h.num_nodes; ++i) {
+			typename G::node_value_type data;
+			data.velocity = v[i];
+			data.mass = mass[i];
+			nodes.push_back(g.add_node(x[i], data));
+		}
+		const int32_t* ends = (const int32_t*) (data_ + layout.endpoints);
+		const scalar* rest = (const scalar*) (data_ + layout.rest);
+		for(std::size_t k = 0; k < h.num_edges; ++k)
+			g.add_edge(nodes[ends[2 * k]], nodes[ends[2 * k + 1]], rest[k]);
+		const point_type* s = (const point_type*) (data_ + layout.state);
+		state.assign(s, s + h.num_state);
+	}
+
+	private:
+	const char* data_;
+	std::size_t size_;
+
+	// True if the sections the header describes lie inside the file. Every
+	// count is at most the file size, so the layout cannot overflow.
+	bool sections_fit_(std::size_t point_bytes) const {
+		const CheckpointHeader& h = header();
+		return h.num_nodes <= size_ && h.num_edges <= size_ &&
+			   h.num_state <= size_ &&
+			   CheckpointLayout(h, point_bytes).size <= size_;
+	}
+
+	// True if every edge joins two checkpointed nodes
+	bool endpoints_valid_(std::size_t point_bytes) const {
+		const CheckpointHeader& h = header();
+		CheckpointLayout layout(h, point_bytes);
+		const int32_t* ends = (const int32_t*) (data_ + layout.endpoints);
+		for(std::size_t k = 0; k < 2 * h.num_edges; ++k)
+			if( ends[k] < 0 || uint64_t(ends[k]) >= h.num_nodes )
+				return false;
+		return true;
+	}
+
+	CheckpointFile(const CheckpointFile&) = delete;
+	void operator=(const CheckpointFile&) = delete;
+};
+
+#endif
@@ -0,0 +1,632 @@
+#ifndef CONTRACTION_HIERARCHY_HPP
+#define CONTRACTION_HIERARCHY_HPP
+
+/** @file ContractionHierarchy.hpp
+ * @brief Contraction hierarchies for repeated distance queries on a fixed
+ * undirected graph.
+ *
+ * Preprocessing removes the nodes one at a time, least important first.
+ * Removing (contracting) v adds a shortcut u-w of length d(u,v) + d(v,w)
+ * for every pair of its remaining neighbors unless a witness search finds
+ * a path from u to w no longer than that which avoids v. A node's
+ * importance is its edge difference, the shortcuts its contraction would
+ * add minus its remaining edges, plus the number of its neighbors already
+ * contracted so that contraction spreads evenly over the graph.
+ *
+ * Contraction runs in rounds. Each round takes every node whose importance
+ * is below that of all its remaining neighbors; these nodes are pairwise
+ * non-adjacent, so their witness searches run in parallel, each avoiding
+ * all the nodes of the round. The shortcuts are then applied serially.
+ *
+ * Contraction stops early once the remaining graph is dense, as happens
+ * at the top of the hierarchy of a 3D mesh, where contracting a node of
+ * degree d costs d^2 witness pairs. The remaining nodes form the core.
+ *
+ * The hierarchy keeps, for every node, its edges and shortcuts to nodes
+ * contracted after it, and for core nodes all their core arcs. A query
+ * runs Dijkstra upward from both endpoints, and through the core, and
+ * meets at the highest node of a shortest path.
+ *
+ * @code
+ * ContractionHierarchy<double> ch;
+ * Adjacency adj = out_adjacency(g);
+ * if( !ch.load("mesh.ch") || ch.num_nodes() != adj.num_nodes() ||
+ * 	ch.graph_arcs() != adj.size() ) {
+ * 	ch.build(adj, euclidean_weights(g, adj));
+ * 	ch.save("mesh.ch");
+ * }
+ * CHQuery<double> query(ch);
+ * double d = query.distance(s, t);
+ * @endcode
+ *
+ * File layout:
+ * 	CHHeader
+ * 	rank[num_nodes]         int32_t
+ * 	offsets[num_nodes + 1]  int64_t
+ * 	targets[num_arcs]       int32_t
+ * 	weights[num_arcs]       D
+ */
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include "Adjacency.hpp"
+#include "ShortestPath.hpp"
+#include "Parallel.hpp"
+
+struct CHHeader {
+	char magic[8];          //< "CS207CH"
+	uint32_t version;
+	uint32_t weight_bytes;  //< sizeof(D)
+	uint64_t num_nodes;
+	uint64_t num_arcs;
+	uint64_t num_shortcuts;
+	uint64_t core_size;
+	uint64_t graph_arcs;    //< Adjacency::size() of the graph built from
+};
+
+/** Upward search graph of a contraction hierarchy.
+ * @tparam D Distance type
+ *
+ * RI: rank_ is a permutation of 0 ... num_nodes()-1
+ * RI: For k in [begin(i), end(i)), rank_[target(k)] > rank_[i] unless
+ * 	both nodes are in the core
+ */
+template <typename D>
+class ContractionHierarchy {
+	public:
+
+	/** Builds the hierarchy of an undirected graph.
+	 * @param[in] adj          out_adjacency() of the graph
+	 * @param[in] weight       Non-negative length of each adjacency entry,
+	 * 	the same in both directions of an edge
+	 * @param[in] max_settled  Nodes a witness search may settle before it
+	 * 	gives up and a shortcut is added anyway
+	 * @param[in] core_degree  Contraction stops once the remaining nodes
+	 * 	have more neighbors than this on average; they form the core
+	 */
+	void build(const Adjacency& adj, const std::vector<D>& weight,
+			   std::size_t max_settled = 64, std::size_t core_degree = 48) {
+		Builder b(adj, weight, max_settled, core_degree);
+		b.run(*this);
+		graph_arcs_ = adj.size();
+	}
+
+	/** Writes the hierarchy to @a path.
+	 * @returns false, with a message on std::cerr, on failure.
+	 */
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		if( !out ) {
+			std::cerr << "contraction hierarchy: cannot open " << path << std::endl;
+			return false;
+		}
+		CHHeader h;
+		std::memset(&h, 0, sizeof(h));
+		std::memcpy(h.magic, "CS207CH", 8);
+		h.version = 2;
+		h.weight_bytes = sizeof(D);
+		h.num_nodes = num_nodes();
+		h.num_arcs = num_arcs();
+		h.num_shortcuts = shortcuts_;
+		h.core_size = core_;
+		h.graph_arcs = graph_arcs_;
+		std::vector<int32_t> rank(rank_.begin(), rank_.end());
+		std::vector<int64_t> offsets(offsets_.begin(), offsets_.end());
+		std::vector<int32_t> targets(targets_.begin(), targets_.end());
+		out.write((const char*) &h, sizeof(h));
+		write_(out, rank);
+		write_(out, offsets);
+		write_(out, targets);
+		write_(out, weights_);
+		if( !out ) {
+			std::cerr << "contraction hierarchy: failed to write " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/** Replaces this hierarchy with the one saved in @a path.
+	 * @returns false if the file does not exist, and false with a message
+	 * 	on std::cerr if it is truncated, inconsistent, or was saved with a
+	 * 	different distance type. This hierarchy is unchanged on failure.
+	 *
+	 * The file is only checked against itself; compare num_nodes() and
+	 * graph_arcs() with the graph before querying it.
+	 */
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		if( !in )
+			return false;
+		CHHeader h;
+		if( !in.read((char*) &h, sizeof(h)) ||
+			std::memcmp(h.magic, "CS207CH", 8) != 0 || h.version != 2 ||
+			h.weight_bytes != sizeof(D) ) {
+			std::cerr << "contraction hierarchy: " << path
+					  << " is not a compatible hierarchy" << std::endl;
+			return false;
+		}
+		const uint64_t max_int = std::numeric_limits<int>::max();
+		if( h.num_nodes >= max_int || h.num_arcs > max_int ||
+			h.core_size > h.num_nodes ) {
+			std::cerr << "contraction hierarchy: " << path << " is corrupt"
+					  << std::endl;
+			return false;
+		}
+		std::vector<int32_t> rank(h.num_nodes);
+		std::vector<int64_t> offsets(h.num_nodes + 1);
+		std::vector<int32_t> targets(h.num_arcs);
+		std::vector<D> weights(h.num_arcs);
+		if( !read_(in, rank) || !read_(in, offsets) || !read_(in, targets) ||
+			!read_(in, weights) ) {
+			std::cerr << "contraction hierarchy: " << path << " is truncated"
+					  << std::endl;
+			return false;
+		}
+		if( !valid_(rank, offsets, targets) ) {
+			std::cerr << "contraction hierarchy: " << path << " is corrupt"
+					  << std::endl;
+			return false;
+		}
+		rank_.assign(rank.begin(), rank.end());
+		offsets_.assign(offsets.begin(), offsets.end());
+		targets_.assign(targets.begin(), targets.end());
+		weights_.swap(weights);
+		shortcuts_ = h.num_shortcuts;
+		core_ = h.core_size;
+		graph_arcs_ = h.graph_arcs;
+		return true;
+	}
+
+	std::size_t num_nodes() const {
+		return rank_.size();
+	}
+
+	// Returns the number of upward edges and shortcuts
+	std::size_t num_arcs() const {
+		return targets_.size();
+	}
+
+	// Returns the number of shortcuts added by contraction
+	std::size_t num_shortcuts() const {
+		return shortcuts_;
+	}
+
+	// Returns the number of uncontracted nodes, which have the top ranks
+	std::size_t core_size() const {
+		return core_;
+	}
+
+	// Returns the number of adjacency entries of the graph built from
+	std::size_t graph_arcs() const {
+		return graph_arcs_;
+	}
+
+	// Position of node @a i in the contraction order
+	int rank(int i) const {
+		return rank_[i];
+	}
+
+	// Range of upward arcs of node i
+	int begin(int i) const {
+		return offsets_[i];
+	}
+
+	int end(int i) const {
+		return offsets_[i + 1];
+	}
+
+	int target(int k) const {
+		return targets_[k];
+	}
+
+	D weight(int k) const {
+		return weights_[k];
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	std::vector<int> rank_;
+	std::vector<int> offsets_;
+	std::vector<int> targets_;
+	std::vector<D> weights_;
+	std::size_t shortcuts_ = 0;
+	std::size_t core_ = 0;
+	std::size_t graph_arcs_ = 0;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	template <typename T>
+	static void write_(std::ostream& out, const std::vector<T>& v) {
+		if( !v.empty() )
+			out.write((const char*) &v[0], v.size() * sizeof(T));
+	}
+
+	template <typename T>
+	static bool read_(std::istream& in, std::vector<T>& v) {
+		return v.empty() || in.read((char*) &v[0], v.size() * sizeof(T));
+	}
+
+	/** Returns true if loaded arrays satisfy the representation invariants
+	 * that queries rely on: @a rank is a permutation, @a offsets run from 0
+	 * to targets.size() without decreasing, and every target is a node.
+	 */
+	static bool valid_(const std::vector<int32_t>& rank,
+					   const std::vector<int64_t>& offsets,
+					   const std::vector<int32_t>& targets) {
+		int64_t n = rank.size();
+		std::vector<char> seen(n, 0);
+		for(int64_t i = 0; i < n; ++i) {
+			if( rank[i] < 0 || rank[i] >= n || seen[rank[i]] )
+				return false;
+			seen[rank[i]] = 1;
+		}
+		if( offsets[0] != 0 || offsets[n] != int64_t(targets.size()) )
+			return false;
+		for(int64_t i = 0; i < n; ++i)
+			if( offsets[i + 1] < offsets[i] )
+				return false;
+		for(std::size_t k = 0; k < targets.size(); ++k)
+			if( targets[k] < 0 || targets[k] >= n )
+				return false;
+		return true;
+	}
+
+	/** Contraction state while building.
+	 * RI: graph_[i] holds the remaining neighbors of a remaining node i,
+	 * 	each once, with the shortest edge or shortcut between them
+	 */
+	class Builder {
+		struct Arc {
+			int target;
+			D weight;
+		};
+
+		struct Shortcut {
+			int u, w;
+			D weight;
+		};
+
+		public:
+
+		Builder(const Adjacency& adj, const std::vector<D>& weight,
+				std::size_t max_settled, std::size_t core_degree)
+				: n_(adj.num_nodes()), max_settled_(max_settled),
+				  estimate_settled_(std::max<std::size_t>(max_settled / 16, 1)),
+				  core_degree_(core_degree),
+				  graph_(n_), up_(n_), rank_(n_, -1), priority_(n_, 0),
+				  deleted_(n_, 0), skip_(n_, 0), scratch_(num_threads()),
+				  found_(num_threads()) {
+			for(std::size_t i = 0; i < n_; ++i)
+				for(int k = adj.begin(i); k < adj.end(i); ++k)
+					if( adj.targets[k] != (int) i )
+						add_arc_(i, adj.targets[k], weight[k]);
+		}
+
+		void run(ContractionHierarchy& ch) {
+			std::vector<int> remaining(n_);
+			for(std::size_t i = 0; i < n_; ++i)
+				remaining[i] = i;
+			update_priorities_(remaining);
+
+			std::vector<char> pick(n_), marked(n_, 0);
+			std::vector<int> round, dirty;
+			std::size_t shortcuts = 0;
+			int next_rank = 0;
+			while( !remaining.empty() && !dense_(remaining) ) {
+				// Nodes less important than all their neighbors
+				parallel_for(0, remaining.size(), [&](std::size_t k) {
+					pick[k] = local_minimum_(remaining[k]);
+				}, 256);
+				round.clear();
+				for(std::size_t k = 0; k < remaining.size(); ++k)
+					if( pick[k] )
+						round.push_back(remaining[k]);
+				for(std::size_t k = 0; k < round.size(); ++k)
+					skip_[round[k]] = 1;
+
+				parallel_for_chunks(0, round.size(),
+						[&](std::size_t b, std::size_t e, unsigned w) {
+					for(std::size_t k = b; k < e; ++k)
+						shortcuts_of_(round[k], scratch_[w], &found_[w]);
+				}, 16);
+
+				dirty.clear();
+				for(std::size_t k = 0; k < round.size(); ++k) {
+					int v = round[k];
+					rank_[v] = next_rank++;
+					up_[v] = graph_[v];
+					for(std::size_t j = 0; j < graph_[v].size(); ++j) {
+						int u = graph_[v][j].target;
+						remove_arc_(u, v);
+						++deleted_[u];
+						dirty.push_back(u);
+					}
+					std::vector<Arc>().swap(graph_[v]);
+				}
+				for(std::size_t w = 0; w < found_.size(); ++w) {
+					for(std::size_t k = 0; k < found_[w].size(); ++k) {
+						const Shortcut& s = found_[w][k];
+						if( add_arc_(s.u, s.w, s.weight) )
+							++shortcuts;
+						add_arc_(s.w, s.u, s.weight);
+					}
+					found_[w].clear();
+				}
+
+				std::size_t kept = 0;
+				for(std::size_t k = 0; k < remaining.size(); ++k)
+					if( rank_[remaining[k]] < 0 )
+						remaining[kept++] = remaining[k];
+				remaining.resize(kept);
+
+				// Neighbors of the round changed, the rest did not
+				std::size_t unique = 0;
+				for(std::size_t k = 0; k < dirty.size(); ++k) {
+					if( !marked[dirty[k]] ) {
+						marked[dirty[k]] = 1;
+						dirty[unique++] = dirty[k];
+					}
+				}
+				dirty.resize(unique);
+				for(std::size_t k = 0; k < dirty.size(); ++k)
+					marked[dirty[k]] = 0;
+				update_priorities_(dirty);
+			}
+
+			// The core keeps its arcs in both directions
+			for(std::size_t k = 0; k < remaining.size(); ++k) {
+				int v = remaining[k];
+				rank_[v] = next_rank++;
+				up_[v] = graph_[v];
+			}
+
+			ch.rank_ = rank_;
+			ch.core_ = remaining.size();
+			ch.shortcuts_ = shortcuts;
+			ch.offsets_.assign(1, 0);
+			ch.targets_.clear();
+			ch.weights_.clear();
+			for(std::size_t i = 0; i < n_; ++i) {
+				for(std::size_t j = 0; j < up_[i].size(); ++j) {
+					ch.targets_.push_back(up_[i][j].target);
+					ch.weights_.push_back(up_[i][j].weight);
+				}
+				ch.offsets_.push_back(ch.targets_.size());
+			}
+		}
+
+		private:
+		std::size_t n_;
+		std::size_t max_settled_;
+		std::size_t estimate_settled_;
+		std::size_t core_degree_;
+		std::vector<std::vector<Arc> > graph_;
+		std::vector<std::vector<Arc> > up_;
+		std::vector<int> rank_;
+		std::vector<int> priority_;
+		std::vector<int> deleted_;
+		// Nodes contracted in this or an earlier round, which witnesses avoid
+		std::vector<char> skip_;
+		std::vector<SearchScratch<D> > scratch_;
+		std::vector<std::vector<Shortcut> > found_;
+
+		// Returns true if the nodes have more than core_degree_ neighbors
+		// on average
+		bool dense_(const std::vector<int>& nodes) const {
+			std::size_t arcs = 0;
+			for(std::size_t k = 0; k < nodes.size(); ++k)
+				arcs += graph_[nodes[k]].size();
+			return arcs > core_degree_ * nodes.size();
+		}
+
+		// Adds or shortens the arc u->v; returns true if it is new
+		bool add_arc_(int u, int v, D weight) {
+			std::vector<Arc>& arcs = graph_[u];
+			for(std::size_t j = 0; j < arcs.size(); ++j) {
+				if( arcs[j].target == v ) {
+					if( weight < arcs[j].weight )
+						arcs[j].weight = weight;
+					return false;
+				}
+			}
+			Arc a = {v, weight};
+			arcs.push_back(a);
+			return true;
+		}
+
+		void remove_arc_(int u, int v) {
+			std::vector<Arc>& arcs = graph_[u];
+			for(std::size_t j = 0; j < arcs.size(); ++j) {
+				if( arcs[j].target == v ) {
+					arcs[j] = arcs.back();
+					arcs.pop_back();
+					return;
+				}
+			}
+		}
+
+		// Spreads ties between equally important nodes over the graph
+		static unsigned mix_(unsigned x) {
+			x ^= x >> 16;
+			x *= 0x45d9f3b;
+			x ^= x >> 16;
+			return x;
+		}
+
+		bool before_(int a, int b) const {
+			if( priority_[a] != priority_[b] )
+				return priority_[a] < priority_[b];
+			return mix_(a) < mix_(b);
+		}
+
+		bool local_minimum_(int v) const {
+			for(std::size_t j = 0; j < graph_[v].size(); ++j)
+				if( !before_(v, graph_[v][j].target) )
+					return false;
+			return true;
+		}
+
+		/** Dijkstra from @a source over the remaining graph, avoiding @a v
+		 * and the nodes of the round ordered before it, until @a limit or
+		 * @a max_settled nodes.
+		 */
+		void witness_search_(int source, int v, D limit, std::size_t max_settled,
+							 SearchScratch<D>& s) const {
+			s.label(source, 0, -1);
+			s.heap.push(source, 0);
+			std::size_t settled = 0;
+			while( !s.heap.empty() && s.heap.top_key() <= limit &&
+				   settled < max_settled ) {
+				int u = s.heap.pop();
+				++settled;
+				D du = s.dist[u];
+				for(std::size_t j = 0; j < graph_[u].size(); ++j) {
+					int x = graph_[u][j].target;
+					if( x == v || (skip_[x] && before_(x, v)) )
+						continue;
+					D dx = du + graph_[u][j].weight;
+					if( dx < s.dist[x] ) {
+						s.label(x, dx, u);
+						s.heap.push(x, dx);
+					}
+				}
+			}
+		}
+
+		/** Counts the shortcuts that contracting @a v needs now, and appends
+		 * them to @a out if it is not null. Counting alone only estimates a
+		 * priority, so it uses shorter witness searches, which may count
+		 * a few shortcuts that are not needed.
+		 */
+		int shortcuts_of_(int v, SearchScratch<D>& s,
+						  std::vector<Shortcut>* out) const {
+			std::size_t max_settled = out ? max_settled_ : estimate_settled_;
+			s.prepare(n_);
+			const std::vector<Arc>& arcs = graph_[v];
+			D longest = 0;
+			for(std::size_t j = 0; j < arcs.size(); ++j)
+				longest = std::max(longest, arcs[j].weight);
+			// Witnesses that tie with v up to rounding are still witnesses
+			D slack = 16 * std::numeric_limits<D>::epsilon();
+			int count = 0;
+			for(std::size_t i = 0; i + 1 < arcs.size(); ++i) {
+				witness_search_(arcs[i].target, v, arcs[i].weight + longest,
+								max_settled, s);
+				for(std::size_t j = i + 1; j < arcs.size(); ++j) {
+					D via = arcs[i].weight + arcs[j].weight;
+					if( s.dist[arcs[j].target] <= via + via * slack )
+						continue;
+					++count;
+					if( out ) {
+						Shortcut c = {arcs[i].target, arcs[j].target, via};
+						out->push_back(c);
+					}
+				}
+				s.clear();
+			}
+			return count;
+		}
+
+		void update_priorities_(const std::vector<int>& nodes) {
+			parallel_for_chunks(0, nodes.size(),
+					[&](std::size_t b, std::size_t e, unsigned w) {
+				for(std::size_t k = b; k < e; ++k) {
+					int v = nodes[k];
+					priority_[v] = shortcuts_of_(v, scratch_[w], NULL)
+								   - (int) graph_[v].size() + deleted_[v];
+				}
+			}, 16);
+		}
+	};
+};
+
+/** Distance queries on a ContractionHierarchy.
+ * Each thread should use its own CHQuery; the hierarchy can be shared.
+ */
+template <typename D>
+class CHQuery {
+	public:
+
+	explicit CHQuery(const ContractionHierarchy<D>& ch)
+			: ch_(ch), settled_(0) {
+	}
+
+	/** Returns the shortest distance from @a source to @a target, or
+	 * ShortestPathTree<D>::unreachable() if there is no path.
+	 */
+	D distance(int source, int target) {
+		forward_.prepare(ch_.num_nodes());
+		backward_.prepare(ch_.num_nodes());
+		forward_.label(source, 0, -1);
+		forward_.heap.push(source, 0);
+		backward_.label(target, 0, -1);
+		backward_.heap.push(target, 0);
+		D best = ShortestPathTree<D>::unreachable();
+		settled_ = 0;
+		while( !forward_.heap.empty() || !backward_.heap.empty() ) {
+			bool forward = backward_.heap.empty() ||
+						   (!forward_.heap.empty() &&
+							forward_.heap.top_key() <= backward_.heap.top_key());
+			SearchScratch<D>& s = forward ? forward_ : backward_;
+			const SearchScratch<D>& other = forward ? backward_ : forward_;
+			// Both searches only move away from the best meeting point now
+			if( !(s.heap.top_key() < best) )
+				break;
+			int u = s.heap.pop();
+			++settled_;
+			D du = s.dist[u];
+			if( other.dist[u] != ShortestPathTree<D>::unreachable() &&
+				du + other.dist[u] < best )
+				best = du + other.dist[u];
+			if( stalled_(u, s) )
+				continue;
+			for(int k = ch_.begin(u); k < ch_.end(u); ++k) {
+				int v = ch_.target(k);
+				D dv = du + ch_.weight(k);
+				if( dv < s.dist[v] ) {
+					s.label(v, dv, u);
+					s.heap.push(v, dv);
+				}
+			}
+		}
+		forward_.clear();
+		backward_.clear();
+		return best;
+	}
+
+	// Returns the nodes settled by the last query
+	std::size_t settled() const {
+		return settled_;
+	}
+
+	private:
+	const ContractionHierarchy<D>& ch_;
+	SearchScratch<D> forward_;
+	SearchScratch<D> backward_;
+	std::size_t settled_;
+
+	/** Returns true if @a u is reached more cheaply down from a higher
+	 * node than its label says; then no shortest path climbs through u,
+	 * and its arcs need not be relaxed (stall-on-demand).
+	 */
+	bool stalled_(int u, const SearchScratch<D>& s) const {
+		for(int k = ch_.begin(u); k < ch_.end(u); ++k)
+			if( s.dist[ch_.target(k)] + ch_.weight(k) < s.dist[u] )
+				return true;
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef CRITICAL_PATH_HPP
+#define CRITICAL_PATH_HPP
+
+/** @file CriticalPath.hpp
+ * @brief Critical path analysis of a weighted DAG of tasks.
+ *
+ * Every node is a task with a duration, and an edge u -> v means that v
+ * starts after u has finished, optionally with a lag. Tasks start as soon
+ * as their predecessors allow, and the makespan is the finish time of the
+ * last task.
+ * - The earliest start of v is the largest finish of a predecessor plus
+ *   the lag of its edge: a longest path forward from the sources.
+ * - The tail of u is its duration plus the largest lag and tail of a
+ *   successor: a longest path backward from the sinks. The latest start
+ *   of u that keeps the makespan is the makespan minus its tail.
+ * - The slack of a task is latest - earliest. The tasks without slack
+ *   are critical: delaying any of them delays the whole schedule.
+ *
+ * Both passes walk the levels of a topological sort, forward then
+ * backward. A node's value depends only on nodes of earlier levels, so
+ * each level is computed in parallel; every node reads its neighbors and
+ * writes only itself, without atomics.
+ *
+ * @code
+ * Adjacency out = out_adjacency(g), in = in_adjacency(g);
+ * Schedule<double> s = critical_path(out, in, duration);
+ * for(int i : s.chain) ... s.slack(i) ...
+ *
+ * Schedule<double> s = schedule(g,
+ * 	[](Node n) { return n.value().cost; }, [](Edge e) { return 0.0; });
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+#include "TopologicalSort.hpp"
+
+/** Result of a critical path analysis, by node index.
+ * Empty, except for order, if the graph has a cycle.
+ * RI: earliest[v] >= earliest[u] + duration(u) + lag(u -> v) for every edge
+ * RI: latest[i] >= earliest[i], up to rounding
+ * RI: chain is a path from a source to a sink whose durations and lags add
+ * 	up to makespan
+ */
+template <typename D>
+struct Schedule {
+	typedef D time_type;
+
+	TopologicalOrder order;
+	std::vector<D> earliest;
+	std::vector<D> latest;
+	std::vector<int> chain;
+	D makespan;
+
+	Schedule() : makespan(0) {
+	}
+
+	// False if the graph has a cycle and could not be scheduled
+	bool acyclic() const {
+		return order.acyclic();
+	}
+
+	// How long task @a i can be delayed without delaying the makespan
+	D slack(int i) const {
+		return std::max(D(0), latest[i] - earliest[i]);
+	}
+};
+
+/** Computes the earliest and latest start of every task of a DAG.
+ * @param[in] out      The out_adjacency() of a directed graph
+ * @param[in] in       The in_adjacency() of the same graph
+ * @param[in] duration Duration of each node by index
+ * @param[in] lag      Delay of each edge by Graph edge index, between the
+ * 	finish of its first node and the start of its second; empty for none
+ * @param[out] result  The schedule, empty if the graph has a cycle
+ * @returns result.acyclic()
+ */
+template <typename D>
+bool critical_path(const Adjacency& out, const Adjacency& in,
+				   const std::vector<D>& duration, const std::vector<D>& lag,
+				   Schedule<D>& result) {
+	std::size_t n = out.num_nodes();
+	topological_sort(out, result.order);
+	result.chain.clear();
+	result.makespan = 0;
+	if( !result.acyclic() ) {
+		result.earliest.clear();
+		result.latest.clear();
+		return false;
+	}
+	const TopologicalOrder& t = result.order;
+	std::vector<D>& earliest = result.earliest;
+	std::vector<D>& latest = result.latest;
+	earliest.assign(n, 0);
+	latest.assign(n, 0);
+	// The predecessor that fixes each earliest start, for the chain
+	std::vector<int> pred(n, -1);
+
+	// Longest paths from the sources, pulled from the previous levels
+	for(std::size_t l = 1; l < t.num_levels(); ++l) {
+		parallel_for(t.begin(l), t.end(l), [&](std::size_t k) {
+			int v = t.order[k];
+			D start = 0;
+			int from = -1;
+			for(int j = in.begin(v); j < in.end(v); ++j) {
+				int u = in.targets[j];
+				D ready = earliest[u] + duration[u] + (lag.empty() ? D(0) : lag[in.edges[j]]);
+				if( from < 0 || start < ready ) {
+					start = ready;
+					from = u;
+				}
+			}
+			earliest[v] = start;
+			pred[v] = from;
+		}, 1024);
+	}
+
+	// The task that finishes last ends the critical chain
+	int last = -1;
+	for(std::size_t i = 0; i < n; ++i) {
+		if( last < 0 || result.makespan < earliest[i] + duration[i] ) {
+			result.makespan = earliest[i] + duration[i];
+			last = i;
+		}
+	}
+	for(int i = last; i >= 0; i = pred[i])
+		result.chain.push_back(i);
+	std::reverse(result.chain.begin(), result.chain.end());
+
+	// Longest paths to the sinks, stored in latest as the tails first
+	for(int l = int(t.num_levels()) - 1; l >= 0; --l) {
+		parallel_for(t.begin(l), t.end(l), [&](std::size_t k) {
+			int u = t.order[k];
+			D after = 0;
+			for(int j = out.begin(u); j < out.end(u); ++j) {
+				int v = out.targets[j];
+				after = std::max(after, (lag.empty() ? D(0) : lag[out.edges[j]]) + latest[v]);
+			}
+			latest[u] = duration[u] + after;
+		}, 1024);
+	}
+	parallel_for(0, n, [&](std::size_t i) {
+		latest[i] = result.makespan - latest[i];
+	});
+	return true;
+}
+
+/** Computes the schedule of a DAG of tasks without lags.
+ * @returns The schedule; check acyclic() before reading it
+ */
+template <typename D>
+Schedule<D> critical_path(const Adjacency& out, const Adjacency& in,
+						  const std::vector<D>& duration) {
+	Schedule<D> result;
+	critical_path(out, in, duration, std::vector<D>(), result);
+	return result;
+}
+
+/** Computes the schedule of the directed graph @a g.
+ * @param[in] duration Functor returning the duration of a Node as a double
+ * @param[in] lag      Functor returning the lag of an Edge as a double
+ * @returns The schedule by node index; check acyclic() before reading it
+ */
+template <typename G, typename F, typename L>
+Schedule<double> schedule(G& g, F duration, L lag) {
+	std::vector<double> d;
+	d.reserve(g.num_nodes());
+	for(auto it = g.node_begin(); it != g.node_end(); ++it)
+		d.push_back(duration(*it));
+	std::vector<double> w(g.num_edges());
+	for(auto it = g.edge_begin(); it != g.edge_end(); ++it)
+		w[(*it).index()] = lag(*it);
+	Schedule<double> result;
+	critical_path(out_adjacency(g), in_adjacency(g), d, w, result);
+	return result;
+}
+
+#endif
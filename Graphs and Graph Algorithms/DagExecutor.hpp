@@ -0,0 +1,206 @@
+#ifndef DAG_EXECUTOR_HPP
+#define DAG_EXECUTOR_HPP
+
+/** @file DagExecutor.hpp
+ * @brief Parallel execution of the nodes of a dependency DAG as tasks.
+ *
+ * A node becomes ready when every node with an edge into it has run. Each
+ * node keeps an atomic count of the predecessors still to run; the thread
+ * that brings the count to zero queues the node on its own ready queue.
+ *
+ * Every thread of the pool owns a ready queue. A thread runs the tasks of
+ * its own queue first and steals from the others when it runs out, so
+ * successors tend to run on the thread that released them, while their
+ * inputs are still in its cache. The queues are ordered by critical path:
+ * a task's priority is its bottom level, the largest total cost of a path
+ * from it to a sink, so the tasks that hold up the longest chains run
+ * first. Owners and thieves both take the highest priority.
+ *
+ * Tasks run inside the pool's threads, so parallel loops started from a
+ * task run serially.
+ *
+ * @code
+ * Adjacency out = out_adjacency(g);  // g is a directed graph
+ * DagExecutor exec(out);
+ * exec.run([&](int i, unsigned thread) { build(i); });
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+#include "TopologicalSort.hpp"
+
+/** Runs the nodes of a DAG in parallel, each after its predecessors.
+ * The DAG is fixed at construction; run() may be called many times.
+ */
+class DagExecutor {
+	public:
+
+	/** @param[in] out  The out_adjacency() of a directed graph
+	 * @param[in] cost Estimated cost of each node by index, for the
+	 * 	critical path; empty for unit costs
+	 */
+	explicit DagExecutor(const Adjacency& out,
+						 const std::vector<double>& cost = std::vector<double>())
+			: out_(out), order_(topological_sort(out)),
+			  bottom_level_(out.num_nodes(), 0),
+			  pending_(new std::atomic<int>[out.num_nodes()]),
+			  steals_(0) {
+		std::size_t n = out.num_nodes();
+		in_degree_.assign(n, 0);
+		for(std::size_t k = 0; k < out.size(); ++k)
+			++in_degree_[out.targets[k]];
+		if( !acyclic() )
+			return;
+		// Successors are on later levels, so each level only reads finished
+		// bottom levels
+		for(int l = int(order_.num_levels()) - 1; l >= 0; --l) {
+			parallel_for(order_.begin(l), order_.end(l), [&](std::size_t k) {
+				int u = order_.order[k];
+				double longest = 0;
+				for(int j = out_.begin(u); j < out_.end(u); ++j)
+					longest = std::max(longest, bottom_level_[out_.targets[j]]);
+				bottom_level_[u] = longest + (cost.empty() ? 1 : cost[u]);
+			}, 1024);
+		}
+	}
+
+	// False if the graph has a cycle; then run() does nothing
+	bool acyclic() const {
+		return order_.acyclic();
+	}
+
+	// Largest total cost of a path that starts at node @a i
+	double bottom_level(int i) const {
+		return bottom_level_[i];
+	}
+
+	// Total cost of the longest path, a lower bound on the run time
+	double critical_path() const {
+		double longest = 0;
+		for(std::size_t i = 0; i < bottom_level_.size(); ++i)
+			longest = std::max(longest, bottom_level_[i]);
+		return longest;
+	}
+
+	// Number of tasks taken from another thread's queue by the last run
+	std::size_t steals() const {
+		return steals_;
+	}
+
+	/** Calls @a task(i, w) once for every node i, after it has returned for
+	 * every predecessor of i. w identifies the calling thread,
+	 * 0 <= w < num_threads().
+	 * @returns false, without calling @a task, if the graph has a cycle
+	 * @pre @a task does not throw
+	 */
+	template <typename F>
+	bool run(F task) {
+		if( !acyclic() )
+			return false;
+		std::size_t n = out_.num_nodes();
+		unsigned threads = num_threads();
+		queues_.reset(new ReadyQueue[threads]);
+		for(std::size_t i = 0; i < n; ++i)
+			pending_[i].store(in_degree_[i], std::memory_order_relaxed);
+		// Deal the sources out; each queue orders its own by priority
+		for(int k = order_.begin(0); k < order_.end(0); ++k)
+			queues_[k % threads].push(order_.order[k], bottom_level_[order_.order[k]]);
+		remaining_.store(n);
+		std::atomic<std::size_t> steals(0);
+
+		parallel_for_chunks(0, threads,
+				[&](std::size_t, std::size_t, unsigned w) {
+			std::size_t stolen = 0;
+			while( remaining_.load(std::memory_order_acquire) > 0 ) {
+				int u = queues_[w].pop();
+				for(unsigned k = 1; u < 0 && k < threads; ++k)
+					if( (u = queues_[(w + k) % threads].pop()) >= 0 )
+						++stolen;
+				if( u < 0 ) {
+					std::this_thread::yield();
+					continue;
+				}
+				task(u, w);
+				for(int j = out_.begin(u); j < out_.end(u); ++j) {
+					int v = out_.targets[j];
+					if( pending_[v].fetch_sub(1, std::memory_order_acq_rel) == 1 )
+						queues_[w].push(v, bottom_level_[v]);
+				}
+				remaining_.fetch_sub(1, std::memory_order_release);
+			}
+			steals += stolen;
+		}, 1);
+		steals_ = steals;
+		return true;
+	}
+
+	private:
+
+	/** Ready tasks of one thread, highest priority first. */
+	class ReadyQueue {
+		public:
+
+		void push(int task, double priority) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			heap_.push_back(std::make_pair(priority, task));
+			std::push_heap(heap_.begin(), heap_.end());
+		}
+
+		// Removes and returns the most critical task, or -1 if empty
+		int pop() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if( heap_.empty() )
+				return -1;
+			std::pop_heap(heap_.begin(), heap_.end());
+			int task = heap_.back().second;
+			heap_.pop_back();
+			return task;
+		}
+
+		private:
+		std::mutex mutex_;
+		std::vector<std::pair<double, int> > heap_;
+	};
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	const Adjacency& out_;
+	TopologicalOrder order_;
+	std::vector<int> in_degree_;
+	std::vector<double> bottom_level_;
+
+	// State of a run
+	std::unique_ptr<std::atomic<int>[]> pending_;
+	std::unique_ptr<ReadyQueue[]> queues_;
+	std::atomic<std::size_t> remaining_;
+	std::size_t steals_;
+};
+
+/** Runs every node of the directed graph @a g as a task by calling its
+ * value, after the nodes with edges into it.
+ * @tparam G Graph type whose node_value_type is callable with no arguments,
+ * 	such as std::function<void()>
+ * @returns false, without running anything, if @a g has a cycle
+ */
+template <typename G>
+bool execute(G& g) {
+	Adjacency out = out_adjacency(g);
+	std::vector<typename G::node_type> nodes;
+	nodes.reserve(g.num_nodes());
+	for(auto it = g.node_begin(); it != g.node_end(); ++it)
+		nodes.push_back(*it);
+	DagExecutor exec(out);
+	return exec.run([&](int i, unsigned) { nodes[i].value()(); });
+}
+
+#endif
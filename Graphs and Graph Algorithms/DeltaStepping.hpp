@@ -0,0 +1,312 @@
+#ifndef DELTA_STEPPING_HPP
+#define DELTA_STEPPING_HPP
+
+/** @file DeltaStepping.hpp
+ * @brief Parallel shortest paths from one or several sources by
+ * delta-stepping.
+ *
+ * Tentative distances are grouped into buckets of width delta. The lowest
+ * nonempty bucket is settled by repeatedly relaxing the light edges
+ * (weight <= delta) of its nodes in parallel, which may refill the same
+ * bucket; the heavy edges of the settled nodes are then relaxed once,
+ * since they can only reach later buckets. Distances are lowered with an
+ * atomic compare-and-swap, and each thread collects the nodes it lowered
+ * in its own buffer, so no locks are taken during a phase.
+ *
+ * Predecessors are recovered after the search: v's predecessor is the
+ * smallest u with dist[u] + w(u, v) == dist[v], which makes the result
+ * independent of thread timing. Edges of length zero, as between
+ * coincident mesh nodes, tie the distances of their ends; such ties are
+ * broken outward from the sources so the predecessors still form a forest.
+ */
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include "Adjacency.hpp"
+#include "ShortestPath.hpp"
+#include "Parallel.hpp"
+
+/** Delta-stepping solver for one weighted Adjacency, reusable across
+ * sources.
+ * @tparam D Floating point distance type
+ *
+ * RI: For node i, the entries [begin_[i], light_end_[i]) of targets_ and
+ * 	weight_ are its light edges and [light_end_[i], begin_[i+1]) its
+ * 	heavy edges.
+ */
+template <typename D>
+class DeltaStepping {
+	public:
+
+	// Graphs with fewer nodes, or runs with one thread, use Dijkstra
+	static const std::size_t min_parallel_nodes = 8192;
+
+	/** Prepares the light/heavy split of @a adj.
+	 * @param[in] weight Nonnegative length of each adjacency entry
+	 * @param[in] delta  Bucket width; if not positive, the mean weight
+	 */
+	DeltaStepping(const Adjacency& adj, const std::vector<D>& weight,
+				  D delta = 0)
+			: adj_(adj), weight_in_(weight), delta_(delta) {
+		std::size_t n = adj.num_nodes();
+		if( !(delta_ > 0) ) {
+			D sum = 0;
+			for(std::size_t k = 0; k < weight.size(); ++k)
+				sum += weight[k];
+			delta_ = weight.empty() ? 1 : sum / weight.size();
+		}
+		begin_.resize(n + 1);
+		light_end_.resize(n);
+		targets_.resize(adj.size());
+		weight_.resize(adj.size());
+		parallel_for(0, n, [&](std::size_t i) {
+			int out = adj.begin(i);
+			begin_[i] = out;
+			for(int k = adj.begin(i); k < adj.end(i); ++k) {
+				if( weight[k] <= delta_ ) {
+					targets_[out] = adj.targets[k];
+					weight_[out++] = weight[k];
+				}
+			}
+			light_end_[i] = out;
+			for(int k = adj.begin(i); k < adj.end(i); ++k) {
+				if( !(weight[k] <= delta_) ) {
+					targets_[out] = adj.targets[k];
+					weight_[out++] = weight[k];
+				}
+			}
+		});
+		begin_[n] = adj.size();
+	}
+
+	D delta() const {
+		return delta_;
+	}
+
+	// Computes the shortest paths from @a source into @a tree
+	void run(int source, ShortestPathTree<D>& tree) {
+		run(std::vector<int>(1, source), tree);
+	}
+
+	ShortestPathTree<D> run(int source) {
+		ShortestPathTree<D> tree;
+		run(source, tree);
+		return tree;
+	}
+
+	/** Computes the shortest paths from the nearest of @a sources into
+	 * @a tree, in one search with every source at distance 0.
+	 */
+	void run(const std::vector<int>& sources, ShortestPathTree<D>& tree) {
+		std::size_t n = adj_.num_nodes();
+		if( n < min_parallel_nodes || num_threads() == 1 ) {
+			IndexedHeap<D> heap;
+			dijkstra(adj_, weight_in_, sources, tree, heap);
+			return;
+		}
+
+		dist_.reset(new std::atomic<D>[n]);
+		parallel_for(0, n, [&](std::size_t i) {
+			dist_[i].store(ShortestPathTree<D>::unreachable(),
+						   std::memory_order_relaxed);
+		}, 4096);
+		stamp_.assign(n, -1);
+		settled_stamp_.assign(n, -1);
+		requests_.resize(num_threads());
+		buckets_.assign(1, sources);
+		for(std::size_t k = 0; k < sources.size(); ++k)
+			dist_[sources[k]].store(0);
+
+		int round = 0;
+		for(std::size_t b = 0; b < buckets_.size(); ++b) {
+			settled_.clear();
+			while( !buckets_[b].empty() ) {
+				// Keep the nodes still in bucket b, once each
+				frontier_.clear();
+				std::vector<int>& bucket = buckets_[b];
+				for(std::size_t k = 0; k < bucket.size(); ++k) {
+					int u = bucket[k];
+					if( stamp_[u] == round || bucket_of_(u) != b )
+						continue;
+					stamp_[u] = round;
+					frontier_.push_back(u);
+					if( settled_stamp_[u] != (long) b ) {
+						settled_stamp_[u] = b;
+						settled_.push_back(u);
+					}
+				}
+				bucket.clear();
+				++round;
+				relax_(frontier_, true);
+			}
+			relax_(settled_, false);
+		}
+
+		tree.reset(n);
+		for(std::size_t i = 0; i < n; ++i)
+			tree.dist[i] = dist_[i].load(std::memory_order_relaxed);
+		find_predecessors_(tree, sources);
+	}
+
+	/** Distance field of several sources, as for Voronoi regions.
+	 * @param[out] owner For each node, the position in @a sources of its
+	 * 	nearest source, or -1 if it is unreachable.
+	 */
+	void run(const std::vector<int>& sources, ShortestPathTree<D>& tree,
+			 std::vector<int>& owner) {
+		run(sources, tree);
+		owner = path_sources(tree, sources);
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	const Adjacency& adj_;
+	const std::vector<D>& weight_in_;
+	D delta_;
+
+	// Adjacency reordered with the light edges of each node first
+	std::vector<int> begin_;
+	std::vector<int> light_end_;
+	std::vector<int> targets_;
+	std::vector<D> weight_;
+
+	// Search state, by node index
+	std::unique_ptr<std::atomic<D>[]> dist_;
+	std::vector<int> stamp_;          // Last light round u was relaxed in
+	std::vector<long> settled_stamp_; // Last bucket u was settled in
+
+	std::vector<std::vector<int> > buckets_;
+	std::vector<int> frontier_;
+	std::vector<int> settled_;
+	// Nodes lowered by each thread during a phase, with their bucket
+	std::vector<std::vector<std::pair<std::size_t, int> > > requests_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	std::size_t bucket_of_(int u) const {
+		return (std::size_t) (dist_[u].load(std::memory_order_relaxed) / delta_);
+	}
+
+	/** Relaxes the light (or heavy) edges of @a nodes in parallel, then
+	 * files the lowered nodes into their buckets.
+	 */
+	void relax_(const std::vector<int>& nodes, bool light) {
+		parallel_for_chunks(0, nodes.size(),
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			std::vector<std::pair<std::size_t, int> >& out = requests_[w];
+			for(std::size_t k = b; k < e; ++k) {
+				int u = nodes[k];
+				D du = dist_[u].load(std::memory_order_relaxed);
+				int first = light ? begin_[u] : light_end_[u];
+				int last = light ? light_end_[u] : begin_[u + 1];
+				for(int j = first; j < last; ++j) {
+					int v = targets_[j];
+					D dv = du + weight_[j];
+					D old = dist_[v].load(std::memory_order_relaxed);
+					while( dv < old ) {
+						if( dist_[v].compare_exchange_weak(old, dv) ) {
+							out.push_back(std::make_pair((std::size_t) (dv / delta_), v));
+							break;
+						}
+					}
+				}
+			}
+		}, 64);
+
+		for(std::size_t w = 0; w < requests_.size(); ++w) {
+			std::vector<std::pair<std::size_t, int> >& out = requests_[w];
+			for(std::size_t k = 0; k < out.size(); ++k) {
+				if( out[k].first >= buckets_.size() )
+					buckets_.resize(out[k].first + 1);
+				buckets_[out[k].first].push_back(out[k].second);
+			}
+			out.clear();
+		}
+	}
+
+	/** Sets tree.pred[v] to the smallest u whose edge gives v its distance,
+	 * and leaves @a sources at -1.
+	 *
+	 * A predecessor at a smaller distance is found in one pass. Nodes left
+	 * without one are reached only through edges that do not add length,
+	 * from nodes at the same distance; they get their predecessors in
+	 * rounds, each from nodes given one in an earlier round. Following
+	 * predecessors then always lowers the distance or the round, so it
+	 * cannot loop.
+	 */
+	void find_predecessors_(ShortestPathTree<D>& tree,
+							const std::vector<int>& sources) {
+		std::size_t n = adj_.num_nodes();
+		std::unique_ptr<std::atomic<int>[]> pred(new std::atomic<int>[n]);
+		for(std::size_t i = 0; i < n; ++i)
+			pred[i].store(-1, std::memory_order_relaxed);
+		// Lowers pred[v] to u; returns true if v had no predecessor yet
+		auto offer = [&](int v, int u) {
+			int old = pred[v].load(std::memory_order_relaxed);
+			while( (old < 0 || u < old) &&
+				   !pred[v].compare_exchange_weak(old, u) ) {
+			}
+			return old < 0;
+		};
+		parallel_for(0, n, [&](std::size_t u) {
+			D du = tree.dist[u];
+			if( du == ShortestPathTree<D>::unreachable() )
+				return;
+			for(int j = begin_[u]; j < begin_[u + 1]; ++j) {
+				int v = targets_[j];
+				if( du < tree.dist[v] && du + weight_[j] == tree.dist[v] )
+					offer(v, u);
+			}
+		});
+
+		std::vector<char> anchored(n, 0);
+		std::vector<int> frontier(sources);
+		std::size_t pending = 0;
+		for(std::size_t k = 0; k < sources.size(); ++k)
+			anchored[sources[k]] = 1;
+		for(std::size_t i = 0; i < n; ++i) {
+			if( pred[i].load(std::memory_order_relaxed) >= 0 ) {
+				anchored[i] = 1;
+				frontier.push_back(i);
+			} else if( !anchored[i] && tree.reached(i) ) {
+				++pending;
+			}
+		}
+		std::vector<std::vector<int> > found(num_threads());
+		while( pending > 0 && !frontier.empty() ) {
+			parallel_for_chunks(0, frontier.size(),
+					[&](std::size_t b, std::size_t e, unsigned w) {
+				for(std::size_t k = b; k < e; ++k) {
+					int u = frontier[k];
+					D du = tree.dist[u];
+					for(int j = begin_[u]; j < begin_[u + 1]; ++j) {
+						int v = targets_[j];
+						if( !anchored[v] && du == tree.dist[v] &&
+							du + weight_[j] == du && offer(v, u) )
+							found[w].push_back(v);
+					}
+				}
+			}, 64);
+			frontier.clear();
+			for(std::size_t w = 0; w < found.size(); ++w) {
+				for(std::size_t k = 0; k < found[w].size(); ++k)
+					anchored[found[w][k]] = 1;
+				frontier.insert(frontier.end(), found[w].begin(), found[w].end());
+				found[w].clear();
+			}
+			pending -= frontier.size();
+		}
+		for(std::size_t i = 0; i < n; ++i)
+			tree.pred[i] = pred[i].load(std::memory_order_relaxed);
+	}
+};
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef DYNAMIC_SHORTEST_PATH_HPP
+#define DYNAMIC_SHORTEST_PATH_HPP
+
+/** @file DynamicShortestPath.hpp
+ * @brief Shortest-path distances that follow changes to a Graph.
+ *
+ * DynamicShortestPaths registers itself as an observer of a Graph and
+ * keeps the distances from one source up to date as nodes and edges come
+ * and go, instead of recomputing them after every change.
+ * - Removing an edge u -> v matters only if u is v's parent in the
+ *   shortest-path tree. Then the subtree under v loses its distances; each
+ *   of its nodes takes the best distance offered by a neighbor outside the
+ *   subtree, and a Dijkstra search limited to the subtree settles the rest.
+ *   Distances outside the subtree cannot change.
+ * - Removing a node cuts its subtree off the same way, once, before the
+ *   Graph reports the removal of each of its edges.
+ * - Adding an edge u -> v can only shorten paths through v, so a Dijkstra
+ *   search starts at v if the edge improves it and stops where nothing
+ *   improves.
+ * Each change therefore costs time in the nodes whose distance or parent
+ * changes and in their edges, not in the size of the graph.
+ *
+ * Edges are as long as the distance between their nodes when added. State
+ * is kept by Node::uid(), which does not shift when nodes are removed.
+ *
+ * @code
+ * DynamicShortestPaths<GraphType> sp(g, g.node(0));
+ * g.remove_node(g.node(42));
+ * double d = sp.distance(g.node(7));
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include "ShortestPath.hpp"
+
+/** Distances from a source node of a Graph, repaired after each change.
+ * @tparam G Graph type
+ * @tparam D Distance type
+ *
+ * RI: dist_[u] == unreachable() iff u is not reached; then pred_[u] == -1
+ * RI: pred_[u] is the uid before u on a shortest path, -1 for the source
+ */
+template <typename G, typename D = double>
+class DynamicShortestPaths : public G::Observer {
+	public:
+
+	typedef typename G::node_type node_type;
+	typedef typename G::edge_type edge_type;
+
+	/** Computes the distances from @a source and starts following @a g.
+	 * @pre @a g outlives this object, or this object is destroyed first
+	 */
+	DynamicShortestPaths(G& g, node_type source)
+			: g_(g), directed_(g.directed()), repaired_(0) {
+		rebuild_(source.uid());
+		g_.add_observer(this);
+	}
+
+	~DynamicShortestPaths() {
+		g_.remove_observer(this);
+	}
+
+	DynamicShortestPaths(const DynamicShortestPaths&) = delete;
+	DynamicShortestPaths& operator=(const DynamicShortestPaths&) = delete;
+
+	static D unreachable() {
+		return ShortestPathTree<D>::unreachable();
+	}
+
+	D distance(const node_type& n) const {
+		return dist_[n.uid()];
+	}
+
+	bool reached(const node_type& n) const {
+		return dist_[n.uid()] != unreachable();
+	}
+
+	// Returns true until the source is removed from the graph
+	bool has_source() const {
+		return source_ >= 0;
+	}
+
+	// Returns the distance of every node by node index
+	std::vector<D> distances() {
+		std::vector<D> d;
+		d.reserve(g_.num_nodes());
+		for(auto it = g_.node_begin(); it != g_.node_end(); ++it)
+			d.push_back(dist_[(*it).uid()]);
+		return d;
+	}
+
+	/** Number of nodes whose distance was recomputed by the last change.
+	 * Graph::remove_node() counts as one change.
+	 */
+	std::size_t last_repaired() const {
+		return repaired_;
+	}
+
+	/////////////////////////////////////////////////////////////////////
+	///// GRAPH EVENTS //////////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	void node_added(node_type n) override {
+		std::size_t size = n.uid() + 1;
+		if( size > dist_.size() ) {
+			dist_.resize(size, unreachable());
+			pred_.resize(size, -1);
+			out_.resize(size);
+			in_.resize(size);
+			heap_.grow(size);
+		}
+		repaired_ = 0;
+	}
+
+	void node_removed(node_type n) override {
+		int u = n.uid();
+		if( u == source_ )
+			source_ = -1;
+		cut_(u);
+		// Detach u now so its edges, removed next, are already gone
+		for(std::size_t k = 0; k < out_[u].size(); ++k)
+			erase_arc_(in_arcs_(out_[u][k].node), u);
+		for(std::size_t k = 0; k < in_[u].size(); ++k)
+			erase_arc_(out_[in_[u][k].node], u);
+		out_[u].clear();
+		in_[u].clear();
+		repair_();
+	}
+
+	void edge_added(edge_type e) override {
+		int u = e.node1().uid();
+		int v = e.node2().uid();
+		D w = D(norm(e.node1().position() - e.node2().position()));
+		Arc uv = {v, w};
+		Arc vu = {u, w};
+		out_[u].push_back(uv);
+		in_arcs_(v).push_back(vu);
+		repaired_ = 0;
+		relax_(u, v, w);
+		if( !directed_ )
+			relax_(v, u, w);
+		settle_();
+	}
+
+	void edge_removed(edge_type e) override {
+		int u = e.node1().uid();
+		int v = e.node2().uid();
+		bool found = erase_arc_(out_[u], v);
+		erase_arc_(in_arcs_(v), u);
+		// Edges of a removed node were detached by node_removed()
+		if( !found )
+			return;
+		if( pred_[v] == u && !has_arc_(u, v) )
+			cut_(v);
+		if( !directed_ && pred_[u] == v && !has_arc_(v, u) )
+			cut_(u);
+		repair_();
+	}
+
+	void cleared() override {
+		dist_.clear();
+		pred_.clear();
+		out_.clear();
+		in_.clear();
+		heap_.reset(0);
+		source_ = -1;
+		repaired_ = 0;
+	}
+
+	private:
+
+	struct Arc {
+		int node;
+		D length;
+	};
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	G& g_;
+	bool directed_;
+	int source_;
+	std::vector<D> dist_;
+	std::vector<int> pred_;
+	// Arcs by uid. An undirected graph keeps both directions in out_.
+	std::vector<std::vector<Arc> > out_;
+	std::vector<std::vector<Arc> > in_;
+	IndexedHeap<D> heap_;
+	// Nodes cut off by the current change
+	std::vector<int> cut_nodes_;
+	std::size_t repaired_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	// Arcs into node @a u
+	std::vector<Arc>& in_arcs_(int u) {
+		return directed_ ? in_[u] : out_[u];
+	}
+
+	// Erases one arc to @a node from @a arcs; returns false if there is none
+	static bool erase_arc_(std::vector<Arc>& arcs, int node) {
+		for(std::size_t k = 0; k < arcs.size(); ++k) {
+			if( arcs[k].node == node ) {
+				arcs[k] = arcs.back();
+				arcs.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// True if a parallel arc u -> v is left
+	bool has_arc_(int u, int v) const {
+		for(std::size_t k = 0; k < out_[u].size(); ++k)
+			if( out_[u][k].node == v )
+				return true;
+		return false;
+	}
+
+	void rebuild_(int source) {
+		std::size_t size = 0;
+		for(auto it = g_.node_begin(); it != g_.node_end(); ++it)
+			size = std::max(size, std::size_t((*it).uid() + 1));
+		dist_.assign(size, unreachable());
+		pred_.assign(size, -1);
+		out_.assign(size, std::vector<Arc>());
+		in_.assign(size, std::vector<Arc>());
+		heap_.reset(size);
+		for(auto it = g_.edge_begin(); it != g_.edge_end(); ++it) {
+			edge_type e = *it;
+			int u = e.node1().uid();
+			int v = e.node2().uid();
+			D w = D(norm(e.node1().position() - e.node2().position()));
+			Arc uv = {v, w};
+			Arc vu = {u, w};
+			out_[u].push_back(uv);
+			in_arcs_(v).push_back(vu);
+		}
+		source_ = source;
+		dist_[source] = 0;
+		heap_.push(source, 0);
+		settle_();
+	}
+
+	// Labels @a v through the arc from @a u if that is shorter
+	void relax_(int u, int v, D w) {
+		if( dist_[u] == unreachable() )
+			return;
+		D dv = dist_[u] + w;
+		if( dv < dist_[v] ) {
+			dist_[v] = dv;
+			pred_[v] = u;
+			heap_.push(v, dv);
+			++repaired_;
+		}
+	}
+
+	// Runs Dijkstra from the nodes in the heap
+	void settle_() {
+		while( !heap_.empty() ) {
+			int u = heap_.pop();
+			const std::vector<Arc>& arcs = out_[u];
+			for(std::size_t k = 0; k < arcs.size(); ++k)
+				relax_(u, arcs[k].node, arcs[k].length);
+		}
+	}
+
+	// Unlabels the subtree of the shortest-path tree under @a root
+	void cut_(int root) {
+		if( dist_[root] == unreachable() )
+			return;
+		std::size_t first = cut_nodes_.size();
+		cut_nodes_.push_back(root);
+		pred_[root] = -1;
+		for(std::size_t k = first; k < cut_nodes_.size(); ++k) {
+			int u = cut_nodes_[k];
+			dist_[u] = unreachable();
+			// A child of u in the tree is a neighbor that points back at u
+			const std::vector<Arc>& arcs = out_[u];
+			for(std::size_t j = 0; j < arcs.size(); ++j) {
+				int v = arcs[j].node;
+				if( pred_[v] == u && dist_[v] != unreachable() ) {
+					pred_[v] = -1;
+					cut_nodes_.push_back(v);
+				}
+			}
+		}
+	}
+
+	// Relabels the cut nodes from their neighbors outside the cut
+	void repair_() {
+		std::size_t cut = cut_nodes_.size();
+		for(std::size_t k = 0; k < cut_nodes_.size(); ++k) {
+			int v = cut_nodes_[k];
+			const std::vector<Arc>& arcs = in_arcs_(v);
+			for(std::size_t j = 0; j < arcs.size(); ++j) {
+				int u = arcs[j].node;
+				if( dist_[u] == unreachable() )
+					continue;
+				D dv = dist_[u] + arcs[j].length;
+				if( dv < dist_[v] ) {
+					dist_[v] = dv;
+					pred_[v] = u;
+				}
+			}
+			if( dist_[v] != unreachable() )
+				heap_.push(v, dist_[v]);
+		}
+		cut_nodes_.clear();
+		settle_();
+		repaired_ = cut;
+	}
+};
+
+#endif
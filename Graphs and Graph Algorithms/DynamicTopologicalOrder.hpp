@@ -0,0 +1,354 @@
+#ifndef DYNAMIC_TOPOLOGICAL_ORDER_HPP
+#define DYNAMIC_TOPOLOGICAL_ORDER_HPP
+
+/** @file DynamicTopologicalOrder.hpp
+ * @brief Topological order of a directed Graph kept up to date as edges
+ * are added, by the algorithm of Pearce and Kelly.
+ *
+ * Every node holds a position, and every edge goes from a lower to a
+ * higher position. Adding an edge x -> y that already agrees costs
+ * nothing. Otherwise only the nodes with positions between y and x can be
+ * out of order:
+ * - a forward search from y, limited to positions below x's, finds the
+ *   nodes that must now come after x, or reaches x, which means the edge
+ *   closes a cycle;
+ * - a backward search from x, limited to positions above y's, finds the
+ *   nodes that must come before y.
+ * The two sets then swap into the positions they held, the backward set
+ * first, each keeping its order. An insertion costs time in the nodes and
+ * edges of this affected region, not in the size of the graph.
+ *
+ * An edge that closes a cycle stays in the Graph, but it is left out of
+ * the order and the cycle is reported by last_cycle(). It is tried again
+ * whenever an edge is removed. State is kept by Node::uid().
+ *
+ * @code
+ * Graph<int, int> g(true);
+ * DynamicTopologicalOrder<Graph<int, int> > order(g);
+ * g.add_edge(a, b);
+ * if( !order.acyclic() ) ... order.last_cycle() ...
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "Adjacency.hpp"
+#include "TopologicalSort.hpp"
+
+/** Topological order of a directed Graph, repaired on each change.
+ * @tparam G Graph type
+ *
+ * RI: For every edge u -> v not in conflicts_, pos_[u] < pos_[v]
+ * RI: at_[pos_[u]] == u for every node u; removed nodes leave at_ == -1
+ */
+template <typename G>
+class DynamicTopologicalOrder : public G::Observer {
+	public:
+
+	typedef typename G::node_type node_type;
+	typedef typename G::edge_type edge_type;
+
+	/** Orders the nodes of @a g and starts following it.
+	 * @pre @a g is directed
+	 */
+	explicit DynamicTopologicalOrder(G& g) : g_(g), affected_(0) {
+		rebuild_();
+		g_.add_observer(this);
+	}
+
+	~DynamicTopologicalOrder() {
+		g_.remove_observer(this);
+	}
+
+	DynamicTopologicalOrder(const DynamicTopologicalOrder&) = delete;
+	DynamicTopologicalOrder& operator=(const DynamicTopologicalOrder&) = delete;
+
+	// True if every edge of the graph agrees with the order
+	bool acyclic() const {
+		return conflicts_.empty();
+	}
+
+	// Number of edges left out of the order because they close a cycle
+	std::size_t num_conflicts() const {
+		return conflicts_.size();
+	}
+
+	/** Returns the cycle closed by the last edge left out of the order, as
+	 * nodes n0, n1, ..., nk with an edge from each to the next and from nk
+	 * to n0. Empty if no edge has closed a cycle.
+	 */
+	const std::vector<node_type>& last_cycle() const {
+		return cycle_;
+	}
+
+	// True if @a a comes before @a b in the order
+	bool before(const node_type& a, const node_type& b) const {
+		return pos_[a.uid()] < pos_[b.uid()];
+	}
+
+	// Returns every node in order
+	std::vector<node_type> order() const {
+		std::vector<node_type> nodes;
+		for(std::size_t p = 0; p < at_.size(); ++p)
+			if( at_[p] >= 0 )
+				nodes.push_back(node_[at_[p]]);
+		return nodes;
+	}
+
+	// Number of nodes moved by the last edge added
+	std::size_t last_affected() const {
+		return affected_;
+	}
+
+	/////////////////////////////////////////////////////////////////////
+	///// GRAPH EVENTS //////////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	void node_added(node_type n) override {
+		add_node_(n);
+	}
+
+	void node_removed(node_type n) override {
+		int u = n.uid();
+		at_[pos_[u]] = -1;
+		pos_[u] = -1;
+		// Detach u now so its edges, removed next, are already gone
+		for(std::size_t k = 0; k < out_[u].size(); ++k)
+			erase_(in_[out_[u][k]], u);
+		for(std::size_t k = 0; k < in_[u].size(); ++k)
+			erase_(out_[in_[u][k]], u);
+		out_[u].clear();
+		in_[u].clear();
+		std::vector<std::pair<int, int> > retry;
+		for(std::size_t k = 0; k < conflicts_.size(); ++k)
+			if( conflicts_[k].first != u && conflicts_[k].second != u )
+				retry.push_back(conflicts_[k]);
+		retry_(retry);
+	}
+
+	void edge_added(edge_type e) override {
+		insert_(e.node1().uid(), e.node2().uid());
+	}
+
+	void edge_removed(edge_type e) override {
+		int u = e.node1().uid();
+		int v = e.node2().uid();
+		if( !erase_(out_[u], v) ) {
+			for(std::size_t k = 0; k < conflicts_.size(); ++k) {
+				if( conflicts_[k] == std::make_pair(u, v) ) {
+					conflicts_.erase(conflicts_.begin() + k);
+					break;
+				}
+			}
+			return;
+		}
+		erase_(in_[v], u);
+		std::vector<std::pair<int, int> > retry(conflicts_);
+		retry_(retry);
+	}
+
+	void cleared() override {
+		node_.clear();
+		pos_.clear();
+		at_.clear();
+		out_.clear();
+		in_.clear();
+		conflicts_.clear();
+		cycle_.clear();
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	G& g_;
+	// By uid
+	std::vector<node_type> node_;
+	std::vector<int> pos_;
+	std::vector<std::vector<int> > out_;
+	std::vector<std::vector<int> > in_;
+	// Node uid at each position
+	std::vector<int> at_;
+	// Edges (u, v) that close a cycle, left out of out_ and in_
+	std::vector<std::pair<int, int> > conflicts_;
+	std::vector<node_type> cycle_;
+	std::size_t affected_;
+
+	// Scratch for the searches, by uid
+	std::vector<char> seen_;
+	std::vector<int> parent_;
+	std::vector<int> forward_;
+	std::vector<int> backward_;
+	std::vector<int> stack_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	// Inserts the arcs @a retry again: removing an edge or node may have
+	// broken the cycle that kept them out
+	void retry_(const std::vector<std::pair<int, int> >& retry) {
+		conflicts_.clear();
+		for(std::size_t k = 0; k < retry.size(); ++k)
+			insert_(retry[k].first, retry[k].second);
+	}
+
+	static bool erase_(std::vector<int>& list, int u) {
+		for(std::size_t k = 0; k < list.size(); ++k) {
+			if( list[k] == u ) {
+				list[k] = list.back();
+				list.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void add_node_(node_type n) {
+		std::size_t u = n.uid();
+		if( u >= node_.size() ) {
+			node_.resize(u + 1);
+			pos_.resize(u + 1, -1);
+			out_.resize(u + 1);
+			in_.resize(u + 1);
+			seen_.resize(u + 1, 0);
+			parent_.resize(u + 1, -1);
+		}
+		node_[u] = n;
+		pos_[u] = at_.size();
+		at_.push_back(u);
+	}
+
+	// Starts from a static sort; edges on cycles become conflicts
+	void rebuild_() {
+		cleared();
+		Adjacency out = out_adjacency(g_);
+		TopologicalOrder t = topological_sort(out);
+		for(std::size_t k = 0; k < t.order.size(); ++k)
+			add_node_(g_.node(t.order[k]));
+		for(std::size_t i = 0; i < t.level.size(); ++i)
+			if( t.level[i] < 0 )
+				add_node_(g_.node(i));
+		for(auto it = g_.edge_begin(); it != g_.edge_end(); ++it) {
+			edge_type e = *it;
+			insert_(e.node1().uid(), e.node2().uid());
+		}
+	}
+
+	// Adds the arc x -> y, moving the affected region if needed
+	void insert_(int x, int y) {
+		affected_ = 0;
+		int lower = pos_[y];
+		int upper = pos_[x];
+		if( lower > upper ) {
+			link_(x, y);
+			return;
+		}
+		if( x == y )
+			cycle_.assign(1, node_[x]);
+		if( x == y || !search_forward_(y, x, upper) ) {
+			conflicts_.push_back(std::make_pair(x, y));
+			return;
+		}
+		search_backward_(x, lower);
+		reorder_();
+		link_(x, y);
+	}
+
+	void link_(int x, int y) {
+		out_[x].push_back(y);
+		in_[y].push_back(x);
+	}
+
+	/** Collects in forward_ the nodes reachable from @a y with positions
+	 * below @a upper. If @a x is reachable, stores the cycle in cycle_,
+	 * clears the marks and returns false.
+	 */
+	bool search_forward_(int y, int x, int upper) {
+		forward_.clear();
+		stack_.assign(1, y);
+		seen_[y] = 1;
+		parent_[y] = -1;
+		forward_.push_back(y);
+		while( !stack_.empty() ) {
+			int u = stack_.back();
+			stack_.pop_back();
+			for(std::size_t k = 0; k < out_[u].size(); ++k) {
+				int w = out_[u][k];
+				if( w == x ) {
+					cycle_.clear();
+					for(int v = u; v >= 0; v = parent_[v])
+						cycle_.push_back(node_[v]);
+					cycle_.push_back(node_[x]);
+					std::reverse(cycle_.begin(), cycle_.end());
+					unmark_(forward_);
+					return false;
+				}
+				if( !seen_[w] && pos_[w] < upper ) {
+					seen_[w] = 1;
+					parent_[w] = u;
+					forward_.push_back(w);
+					stack_.push_back(w);
+				}
+			}
+		}
+		return true;
+	}
+
+	// Collects in backward_ the nodes that reach @a x with positions above
+	// @a lower
+	void search_backward_(int x, int lower) {
+		backward_.clear();
+		stack_.assign(1, x);
+		seen_[x] = 1;
+		backward_.push_back(x);
+		while( !stack_.empty() ) {
+			int u = stack_.back();
+			stack_.pop_back();
+			for(std::size_t k = 0; k < in_[u].size(); ++k) {
+				int w = in_[u][k];
+				if( !seen_[w] && pos_[w] > lower ) {
+					seen_[w] = 1;
+					backward_.push_back(w);
+					stack_.push_back(w);
+				}
+			}
+		}
+	}
+
+	void unmark_(const std::vector<int>& nodes) {
+		for(std::size_t k = 0; k < nodes.size(); ++k)
+			seen_[nodes[k]] = 0;
+	}
+
+	// Moves backward_ then forward_ into the positions they hold together
+	void reorder_() {
+		unmark_(forward_);
+		unmark_(backward_);
+		auto by_position = [&](int a, int b) { return pos_[a] < pos_[b]; };
+		std::sort(forward_.begin(), forward_.end(), by_position);
+		std::sort(backward_.begin(), backward_.end(), by_position);
+		std::vector<int> slots;
+		slots.reserve(forward_.size() + backward_.size());
+		for(std::size_t k = 0; k < backward_.size(); ++k)
+			slots.push_back(pos_[backward_[k]]);
+		for(std::size_t k = 0; k < forward_.size(); ++k)
+			slots.push_back(pos_[forward_[k]]);
+		std::sort(slots.begin(), slots.end());
+		std::size_t s = 0;
+		for(std::size_t k = 0; k < backward_.size(); ++k, ++s) {
+			pos_[backward_[k]] = slots[s];
+			at_[slots[s]] = backward_[k];
+		}
+		for(std::size_t k = 0; k < forward_.size(); ++k, ++s) {
+			pos_[forward_[k]] = slots[s];
+			at_[slots[s]] = forward_[k];
+		}
+		affected_ = slots.size();
+	}
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+/** @file Ensemble.hpp
+ * @brief Many mass-spring simulations of one mesh with different
+ * parameters.
+ *
+ * The mesh topology, rest lengths, masses and initial positions are
+ * captured once in a SpringTopology and shared read-only by every run.
+ * Each run owns only its position and velocity arrays, so a sweep of
+ * dozens of spring constants, damping coefficients and time steps costs
+ * two state vectors per run. Runs are spread across the thread pool.
+ */
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Point.hpp"
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+#include "CS207/Util.hpp"
+
+/** Immutable mass-spring topology shared by the runs of an ensemble.
+ * @tparam P Point type of the simulation state.
+ * RI: rest.size() == adj.size(); rest[k] is the rest length of entry k
+ * RI: x0, mass and fixed have one entry per node index
+ */
+template <typename P>
+struct SpringTopology {
+	typedef P point_type;
+	typedef typename P::value_type scalar;
+
+	Adjacency adj;
+	std::vector<scalar> rest;
+	std::vector<P> x0;
+	std::vector<scalar> mass;
+	std::vector<char> fixed;
+
+	/** Captures the topology of @a g.
+	 * @pre G::edge_value_type converts to the rest length of the edge and
+	 * 	G::node_value_type has a mass.
+	 * @param[in] is_fixed Predicate called as is_fixed(n) for nodes that
+	 * 	never move.
+	 */
+	template <typename G, typename C>
+	SpringTopology(G& g, C is_fixed) : adj(out_adjacency(g)) {
+		std::vector<scalar> edge_rest(g.num_edges());
+		for(auto it = g.edge_begin(); it != g.edge_end(); ++it) {
+			auto e = *it;
+			edge_rest[e.index()] = e.value();
+		}
+		rest.resize(adj.size());
+		for(std::size_t k = 0; k < adj.size(); ++k)
+			rest[k] = edge_rest[adj.edges[k]];
+		for(auto it = g.node_begin(); it != g.node_end(); ++it) {
+			auto n = *it;
+			x0.push_back(n.position());
+			mass.push_back(n.value().mass);
+			fixed.push_back(is_fixed(n));
+		}
+	}
+
+	std::size_t num_nodes() const {
+		return x0.size();
+	}
+
+	// Returns the memory shared by all runs, in bytes
+	std::size_t bytes() const {
+		return adj.offsets.size() * sizeof(int) +
+			   adj.targets.size() * sizeof(int) +
+			   adj.edges.size() * sizeof(int) +
+			   rest.size() * sizeof(scalar) + x0.size() * sizeof(P) +
+			   mass.size() * sizeof(scalar) + fixed.size() * sizeof(char);
+	}
+};
+
+/** Parameters of one run of an ensemble. */
+struct EnsembleRun {
+	double K;        //< Spring constant
+	double damping;  //< Damping coefficient, force = -damping * velocity
+	double dt;       //< Time step
+	double t_end;    //< End time, runs start at t = 0
+	double gravity;  //< Gravitational acceleration along -z
+};
+
+/** Summary of a finished run. */
+struct EnsembleSummary {
+	EnsembleRun run;
+	std::size_t steps;  //< Number of steps taken
+	bool stable;        //< False if the state stopped being finite
+	double kinetic;     //< Kinetic energy at the end
+	double elastic;     //< Spring potential energy at the end
+	double min_z;       //< Lowest node height at the end
+	double max_speed;   //< Largest node speed at the end
+	double seconds;     //< Wall time of the run
+};
+
+/** State of one run: the only per-run memory. */
+template <typename P>
+struct EnsembleState {
+	std::vector<P> x;
+	std::vector<P> v;
+};
+
+/** Runs one simulation of @a topo with the parameters @a run.
+ * @param[out] state Final positions and velocities
+ *
+ * Steps with symplectic Euler under gravity, spring and damping forces,
+ * the same model as mass_spring's problem 3 force. Spring forces on a
+ * node are summed in double. The run stops early if the state becomes
+ * non-finite.
+ */
+template <typename P>
+EnsembleSummary simulate(const SpringTopology<P>& topo, const EnsembleRun& run,
+						 EnsembleState<P>& state) {
+	PROFILE_SCOPE("ensemble run");
+	CS207::Clock clock;
+	const Adjacency& adj = topo.adj;
+	std::size_t n = topo.num_nodes();
+	state.x = topo.x0;
+	state.v.assign(n, P(0, 0, 0));
+
+	EnsembleSummary summary;
+	summary.run = run;
+	summary.steps = 0;
+	summary.stable = true;
+	for(double t = 0; t < run.t_end && summary.stable; t += run.dt) {
+		for(std::size_t i = 0; i < n; ++i) {
+			if( !topo.fixed[i] )
+				state.x[i] += state.v[i] * run.dt;
+		}
+		for(std::size_t i = 0; i < n; ++i) {
+			if( topo.fixed[i] )
+				continue;
+			Point xi = Point(state.x[i]);
+			Point f = Point(0, 0, -run.gravity * topo.mass[i]);
+			f -= run.damping * Point(state.v[i]);
+			for(int k = adj.begin(i); k < adj.end(i); ++k) {
+				Point d = xi - Point(state.x[adj.targets[k]]);
+				double len = norm(d);
+				f -= (run.K * (len - topo.rest[k]) / len) * d;
+			}
+			state.v[i] += P(f * (run.dt / topo.mass[i]));
+			// std::max would drop a NaN, so test every node
+			if( !std::isfinite((double) normSq(state.v[i])) ||
+				!std::isfinite((double) normSq(state.x[i])) )
+				summary.stable = false;
+		}
+		++summary.steps;
+	}
+
+	// Energies and extents of the final state
+	summary.kinetic = 0;
+	summary.elastic = 0;
+	summary.min_z = n ? (double) state.x[0].z : 0;
+	summary.max_speed = 0;
+	for(std::size_t i = 0; i < n; ++i) {
+		double speed2 = normSq(Point(state.v[i]));
+		summary.kinetic += 0.5 * topo.mass[i] * speed2;
+		// A NaN is kept: std::max and std::min return their first argument
+		// when a comparison with it fails
+		double speed = std::sqrt(speed2);
+		double z = state.x[i].z;
+		summary.max_speed = std::isnan(speed) ? speed : std::max(summary.max_speed, speed);
+		summary.min_z = std::isnan(z) ? z : std::min(summary.min_z, z);
+		for(int k = adj.begin(i); k < adj.end(i); ++k) {
+			// Every spring appears once from each end
+			double stretch = distance(Point(state.x[i]),
+									  Point(state.x[adj.targets[k]])) - topo.rest[k];
+			summary.elastic += 0.25 * run.K * stretch * stretch;
+		}
+	}
+	summary.seconds = clock.seconds();
+	return summary;
+}
+
+/** Runs every parameter set of @a runs on the shared @a topo concurrently.
+ * @returns One summary per run, in the order of @a runs.
+ */
+template <typename P>
+std::vector<EnsembleSummary> run_ensemble(const SpringTopology<P>& topo,
+										  const std::vector<EnsembleRun>& runs) {
+	std::vector<EnsembleSummary> summaries(runs.size());
+	parallel_for(0, runs.size(), [&](std::size_t r) {
+		EnsembleState<P> state;
+		summaries[r] = simulate(topo, runs[r], state);
+	}, 1);
+	return summaries;
+}
+
+#endif
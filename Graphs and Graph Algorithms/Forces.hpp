@@ -0,0 +1,122 @@
+#ifndef FORCES_HPP
+#define FORCES_HPP
+
+/** @file Forces.hpp
+ * @brief Composable node forces for mass-spring graphs.
+ *
+ * Each Stimulus computes one force on a node; a Force sums a list of
+ * stimuli and is what the integrators of Integrators.hpp call. The
+ * mass_spring problem 3 force, for example, is
+ * @code
+ * GravityForce<G> gravity;
+ * MassSpringForce<G> springs;
+ * DampingForce<G> damping(mass);
+ * Force<G> problem3 = Force<G>(&springs) + Force<G>(&gravity) +
+ * 					   Force<G>(&damping);
+ * @endcode
+ * A Force holds pointers to its stimuli, which must outlive it.
+ *
+ * @tparam G Graph type whose node_value_type has a G::point_type velocity
+ * 	and a mass, and whose edge values are rest lengths
+ */
+
+#include <list>
+#include "Point.hpp"
+
+/** A single force acting on a node.
+ * Stimuli return double Points whatever the simulation scalar is, so that
+ * sums over many edges and stimuli do not lose precision in float runs.
+ */
+template <typename G>
+class Stimulus {
+	public:
+		virtual Point apply(typename G::node_type, double)=0;
+		virtual ~Stimulus() {
+		}
+};
+
+template <typename G>
+class Force {
+	public:
+		typedef typename std::list<Stimulus<G>*> f_composition;
+		typedef typename G::point_type point_type;
+		f_composition forces_;
+		Force(Stimulus<G>* s) {
+			forces_.push_front(s);
+		}
+
+		Force(f_composition composite) : forces_(composite) {
+		}
+
+		point_type operator()(typename G::node_type n, double t) const {
+			Point total_force = Point(0,0,0);
+			for(auto it = forces_.begin(); it != forces_.end(); ++it) {
+				total_force = total_force + (*it)->apply(n, t);
+			}
+			return point_type(total_force);
+		}
+
+		Force operator+(Force f) const {
+			f_composition force_list = f.forces_;
+			for(auto it = forces_.begin(); it != forces_.end(); ++it) {
+				force_list.push_front(*it);
+			}
+			return Force(force_list);
+		}
+};
+
+template <typename G>
+class GravityForce : public Stimulus<G> {
+	public:
+		double g_; // Gravitational acceleration along -z
+		GravityForce(double g = 9.81) : g_(g) {
+		}
+		virtual Point apply(typename G::node_type n, double t) {
+			(void) t;
+			return Point(0, 0, -g_ * n.value().mass);
+		}
+};
+
+template <typename G>
+class MassSpringForce : public Stimulus<G> {
+  public:
+	  double K; // Spring constant
+	  MassSpringForce(double k = 100.0) : K(k) {
+	  }
+	  virtual Point apply(typename G::node_type n, double t) {
+		// Initialize variables
+		(void) t;//suppress compiler warning
+		typename G::node_type adjacent_node;
+		double displacement; // displacement from spring rest-length
+		Point direction; // direction of the force
+		Point total_force = Point(0, 0, 0);
+		Point xi, xj; // xi: position of node n; xj position of adjacent node
+
+		xi = Point(n.position());
+		for (auto it = n.edge_begin(); it != n.edge_end(); ++it) {
+			adjacent_node = (*it).node2();
+			if( adjacent_node == n )
+				adjacent_node = (*it).node1();
+			xj = Point(adjacent_node.position());
+			displacement = distance(xi, xj) - (*it).value();
+			direction = (xi - xj) / distance(xi, xj);
+			total_force += -K * displacement * direction;
+		}
+		return total_force;
+	  }
+};
+
+template <typename G>
+class DampingForce : public Stimulus<G> {
+	public:
+		typedef typename G::point_type::value_type scalar;
+		scalar coeff_;
+		DampingForce(scalar coeff) : coeff_(coeff) {
+		}
+		virtual Point apply(typename G::node_type n, double t) {
+			(void) t;
+			return -(Point(n.value().velocity) * coeff_);
+		}
+};
+
+#endif
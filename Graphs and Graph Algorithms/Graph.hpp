@@ -1,11 +1,16 @@
 #include <vector>
 #include <stack>
 #include <set>
+#include <algorithm>
 #include "Point.hpp"
 #include "Utility/error.hpp"
 #include "Utility/debug.hpp"
 
-template<typename NodeData, typename EdgeData>
+/** Graph with user data on nodes and edges.
+ * @tparam P The position type of a node, Point by default. BasicPoint<float>
+ * 	halves the memory taken by positions.
+ */
+template<typename NodeData, typename EdgeData, typename P = Point>
 class Graph {
 
 	// Type aliases for common indices and identifiers
@@ -26,7 +31,7 @@ class Graph {
 		std::set<eid_type> outgoing_edges;
 		std::set<eid_type> incoming_edges;
 
-		mutable Point position;
+		mutable P position;
 		mutable NodeData data;
 
 		// Sets all elements to their default values
@@ -34,11 +39,11 @@ class Graph {
 			idx = idx_type();
 			outgoing_edges.clear();
 			incoming_edges.clear();
-			position = Point();
+			position = P();
 			data = NodeData();
 		}
 
-		NodeInfo(idx_type idx, Point pos, NodeData data) :
+		NodeInfo(idx_type idx, P pos, NodeData data) :
 				idx(idx), position(pos), data(data) {}
 	};
 
@@ -81,6 +86,7 @@ class Graph {
 	typedef Edge edge_type;
 	typedef NodeData node_value_type;
 	typedef EdgeData edge_value_type;
+	typedef P point_type;
 
 	// Declare iterator types
 	typedef std::vector<nid_type> nid_list;
@@ -94,9 +100,28 @@ class Graph {
 	Graph(bool directed = false) : directed_(directed) {
 	}
 
+	/** Copies the nodes and edges of @a other, with their ids and indices.
+	 * Observers follow one graph, so the copy starts with none.
+	 */
+	Graph(const Graph& other)
+			: directed_(other.directed_), nodes_(other.nodes_),
+			  idx2nid_(other.idx2nid_), edges_(other.edges_),
+			  idx2eid_(other.idx2eid_), free_nids_(other.free_nids_),
+			  free_eids_(other.free_eids_) {
+	}
+
+	// Whether a graph is directed is fixed when it is constructed
+	Graph& operator=(const Graph&) = delete;
+
 	// Clears the graph of all nodes and edges.
 	void clear() {
 		clear_data_();
+		for(std::size_t k = 0; k < observers_.size(); ++k)
+			observers_[k]->cleared();
+	}
+
+	bool directed() const {
+		return directed_;
 	}
 
 
@@ -111,11 +136,11 @@ class Graph {
 			Node() : g_(NULL), nid_(-1) {
 			}
 
-			const Point& position() const {
+			const P& position() const {
 				return g_->nodes_[nid_].position;
 			}
 
-			Point& position() {
+			P& position() {
 				return g_->nodes_[nid_].position;
 			}
 
@@ -131,6 +156,12 @@ class Graph {
 				return g_->nodes_[nid_].idx;
 			}
 
+			// Returns an id that, unlike index(), does not change when other
+			// nodes are removed. Ids are not reused until the graph is cleared.
+			int uid() const {
+				return nid_;
+			}
+
 			// By default, iterates over the outgoing edges in a directed
 			// graph. In an undirected graph, iterates over all adjacent
 			// edges to the node.
@@ -205,7 +236,7 @@ class Graph {
 	 * @returns the new node with position @a p
 	 * @post new size() == old size() + 1
 	 */
-	node_type add_node(Point p, 
+	node_type add_node(P p, 
 					   node_value_type v = node_value_type()) {
 		// Declare variables
 		int nid;
@@ -216,6 +247,8 @@ class Graph {
 		idx2nid_.push_back(nid);
 		nodes_.push_back(NodeInfo(idx, p, v));
 
+		for(std::size_t k = 0; k < observers_.size(); ++k)
+			observers_[k]->node_added(Node(this, nid));
 		return Node(this, nid);
 	}
 
@@ -228,14 +261,17 @@ class Graph {
 	// Removes a node from the graph. Invalidates all node iterators.
 	void remove_node(Node n) {
 		nid_type nid = n.nid_;
-		// Remove all outgoing edges associated with this node.
-		for(auto it = nodes_[nid].outgoing_edges.begin(); 
-			it != nodes_[nid].outgoing_edges.end(); ++it) {
+		for(std::size_t k = 0; k < observers_.size(); ++k)
+			observers_[k]->node_removed(n);
+		// Remove all outgoing edges associated with this node. Iterate
+		// over a copy since remove_edge erases from the adjacency set.
+		eid_set outgoing = nodes_[nid].outgoing_edges;
+		for(auto it = outgoing.begin(); it != outgoing.end(); ++it) {
 			remove_edge(Edge(this, *it));
 		}
 		// Remove all incoming edges associated with this node.
-		for(auto it = nodes_[nid].incoming_edges.begin(); 
-			it != nodes_[nid].incoming_edges.end(); ++it) {
+		eid_set incoming = nodes_[nid].incoming_edges;
+		for(auto it = incoming.begin(); it != incoming.end(); ++it) {
 			remove_edge(Edge(this, *it));
 		}
 		// Remove the edge from the index list.
@@ -321,6 +357,8 @@ class Graph {
 			nodes_[n1.nid_].outgoing_edges.emplace(eid);
 			nodes_[n2.nid_].outgoing_edges.emplace(eid);
 		}
+		for(std::size_t k = 0; k < observers_.size(); ++k)
+			observers_[k]->edge_added(Edge(this, eid));
 		return Edge(this, eid);
 	}
 
@@ -350,6 +388,8 @@ class Graph {
 		nid_type nid2 = edges_[eid].nid2;
 		if( has_edge_(nid1, nid2) < 0 )
 			return false;
+		for(std::size_t k = 0; k < observers_.size(); ++k)
+			observers_[k]->edge_removed(e);
 		// Remove the edge from the adjacency lists.
 		nodes_[nid1].outgoing_edges.erase(eid);
 		nodes_[nid2].outgoing_edges.erase(eid);
@@ -425,6 +465,32 @@ class Graph {
 		return node_iterator(this, idx2nid_.end());
 	}
 
+	/** Interface for objects that follow changes to the graph.
+	 * Callbacks run inside the call that changes the graph, while the node
+	 * or edge passed is valid: after it is added, or before it is removed.
+	 * node_removed() runs before the node's edges are removed, and each of
+	 * those removals is then reported by edge_removed().
+	 */
+	class Observer {
+		public:
+			virtual ~Observer() {}
+			virtual void node_added(node_type) {}
+			virtual void node_removed(node_type) {}
+			virtual void edge_added(edge_type) {}
+			virtual void edge_removed(edge_type) {}
+			virtual void cleared() {}
+	};
+
+	// Registers @a o to be told of every later change to the graph
+	void add_observer(Observer* o) {
+		observers_.push_back(o);
+	}
+
+	void remove_observer(Observer* o) {
+		observers_.erase(std::remove(observers_.begin(), observers_.end(), o),
+						 observers_.end());
+	}
+
 	private:
 
 	/////////////////////////////////////////////////////////////////////
@@ -446,6 +512,9 @@ class Graph {
 	std::stack<nid_type> free_nids_;
 	std::stack<eid_type> free_eids_;
 
+	// Objects told of changes to the graph, in registration order
+	std::vector<Observer*> observers_;
+
 	//////////////////////////////////////////////////////////////////////
 	///// HELPER FUNCTIONS ///////////////////////////////////////////////
 	//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,250 @@
+#ifndef INTEGRATORS_HPP
+#define INTEGRATORS_HPP
+
+/** @file Integrators.hpp
+ * @brief Time integrators for mass-spring graphs, used as compile-time
+ * policies.
+ *
+ * Every integrator is a class template over the graph type G whose
+ * objects are called as
+ * @code
+ * t = integrator(g, t, dt, force, fixed);
+ * @endcode
+ * where
+ * 	- g is a G whose node_value_type has a G::point_type velocity and a
+ * 	  mass,
+ * 	- force(n, t) returns the G::point_type force on node n at time t,
+ * 	- fixed(n) returns true for nodes that never move,
+ * and the return value is the next time step (@a t + @a dt).
+ *
+ * The choice of integrator is a template parameter of the caller, so the
+ * inner node loops are inlined rather than dispatched through a virtual
+ * call. All node loops run through parallel_for: within one loop every
+ * node only writes its own state and only reads state that is not being
+ * written in that loop.
+ *
+ * Integrators that keep state between steps index it by node index and
+ * reset it when the number of nodes changes. state() exposes that state
+ * so a checkpoint can save and restore it; it is empty for integrators
+ * whose steps are self-contained.
+ */
+
+#include <vector>
+#include "Point.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+
+/** Symplectic Euler, position first:
+ * 	x^{n+1} = x^{n} + v^{n} dt
+ * 	v^{n+1} = v^{n} + F(x^{n+1}, t) dt / m
+ */
+template <typename G>
+struct SymplecticEuler {
+	typedef typename G::point_type point_type;
+
+	static const char* name() {
+		return "symplectic-euler";
+	}
+
+	template <typename F, typename C>
+	double operator()(G& g, double t, double dt, F force, C fixed) {
+		std::size_t n = g.num_nodes();
+		parallel_for(0, n, [&](std::size_t i) {
+			auto node = g.node(i);
+			if( !fixed(node) )
+				node.position() += node.value().velocity * dt;
+		});
+		{
+			PROFILE_SCOPE("force");
+			parallel_for(0, n, [&](std::size_t i) {
+				auto node = g.node(i);
+				if( !fixed(node) )
+					node.value().velocity += force(node, t) *
+											 (dt / node.value().mass);
+			});
+		}
+		return t + dt;
+	}
+
+	// Nothing is carried between steps
+	std::vector<point_type>& state() {
+		return state_;
+	}
+
+	private:
+	std::vector<point_type> state_;
+};
+
+/** Semi-implicit Euler, velocity first:
+ * 	v^{n+1} = v^{n} + F(x^{n}, t) dt / m
+ * 	x^{n+1} = x^{n} + v^{n+1} dt
+ * Forces are evaluated before any node moves, so they are buffered.
+ */
+template <typename G>
+struct SemiImplicitEuler {
+	typedef typename G::point_type point_type;
+
+	static const char* name() {
+		return "semi-implicit-euler";
+	}
+
+	template <typename F, typename C>
+	double operator()(G& g, double t, double dt, F force, C fixed) {
+		std::size_t n = g.num_nodes();
+		f_.resize(n);
+		{
+			PROFILE_SCOPE("force");
+			parallel_for(0, n, [&](std::size_t i) {
+				f_[i] = force(g.node(i), t);
+			});
+		}
+		parallel_for(0, n, [&](std::size_t i) {
+			auto node = g.node(i);
+			if( fixed(node) )
+				return;
+			node.value().velocity += f_[i] * (dt / node.value().mass);
+			node.position() += node.value().velocity * dt;
+		});
+		return t + dt;
+	}
+
+
+	// Nothing is carried between steps
+	std::vector<point_type>& state() {
+		return state_;
+	}
+
+	private:
+	std::vector<point_type> f_;
+	std::vector<point_type> state_;
+};
+
+/** Velocity Verlet:
+ * 	x^{n+1} = x^{n} + v^{n} dt + a^{n} dt^2 / 2
+ * 	v^{n+1} = v^{n} + (a^{n} + a^{n+1}) dt / 2
+ * The acceleration of the previous step is reused, so each step costs one
+ * force evaluation per node. Velocity-dependent forces see v^{n}.
+ */
+template <typename G>
+struct VelocityVerlet {
+	typedef typename G::point_type point_type;
+
+	static const char* name() {
+		return "velocity-verlet";
+	}
+
+	template <typename F, typename C>
+	double operator()(G& g, double t, double dt, F force, C fixed) {
+		std::size_t n = g.num_nodes();
+		if( a_.size() != n ) {
+			a_.resize(n);
+			parallel_for(0, n, [&](std::size_t i) {
+				auto node = g.node(i);
+				a_[i] = force(node, t) / node.value().mass;
+			});
+		}
+		parallel_for(0, n, [&](std::size_t i) {
+			auto node = g.node(i);
+			if( !fixed(node) )
+				node.position() += (node.value().velocity + (0.5 * dt) * a_[i]) * dt;
+		});
+		{
+			PROFILE_SCOPE("force");
+			parallel_for(0, n, [&](std::size_t i) {
+				auto node = g.node(i);
+				point_type a = force(node, t + dt) / node.value().mass;
+				if( !fixed(node) )
+					node.value().velocity += (0.5 * dt) * (a_[i] + a);
+				a_[i] = a;
+			});
+		}
+		return t + dt;
+	}
+
+	// Accelerations of the last step, by node index
+	std::vector<point_type>& state() {
+		return a_;
+	}
+
+	private:
+	std::vector<point_type> a_;
+};
+
+/** Classical fourth-order Runge-Kutta on the state (x, v).
+ * The graph holds the trial state of each stage while forces are
+ * evaluated; the stage derivatives are kept in dense arrays.
+ */
+template <typename G>
+struct RungeKutta4 {
+	typedef typename G::point_type point_type;
+
+	static const char* name() {
+		return "rk4";
+	}
+
+	template <typename F, typename C>
+	double operator()(G& g, double t, double dt, F force, C fixed) {
+		std::size_t n = g.num_nodes();
+		x0_.resize(n); v0_.resize(n);
+		dx_.resize(n); dv_.resize(n);
+		xs_.resize(n); vs_.resize(n);
+		parallel_for(0, n, [&](std::size_t i) {
+			auto node = g.node(i);
+			x0_[i] = node.position();
+			v0_[i] = node.value().velocity;
+			dx_[i] = point_type(0, 0, 0);
+			dv_[i] = point_type(0, 0, 0);
+		});
+
+		// Stage s evaluates at t + c[s] dt and is weighted by w[s]; the
+		// next trial state is (x0, v0) + c[s+1] dt * (this stage's slope)
+		static const double c[5] = {0, 0.5, 0.5, 1, 0};
+		static const double w[4] = {1, 2, 2, 1};
+		for(int s = 0; s < 4; ++s) {
+			{
+				PROFILE_SCOPE("force");
+				parallel_for(0, n, [&](std::size_t i) {
+					auto node = g.node(i);
+					point_type vel = node.value().velocity;
+					point_type acc = force(node, t + c[s] * dt) / node.value().mass;
+					if( fixed(node) )
+						vel = acc = point_type(0, 0, 0);
+					dx_[i] += w[s] * vel;
+					dv_[i] += w[s] * acc;
+					xs_[i] = vel;
+					vs_[i] = acc;
+				});
+			}
+			if( s == 3 )
+				break;
+			parallel_for(0, n, [&](std::size_t i) {
+				auto node = g.node(i);
+				node.position() = x0_[i] + (c[s + 1] * dt) * xs_[i];
+				node.value().velocity = v0_[i] + (c[s + 1] * dt) * vs_[i];
+			});
+		}
+
+		parallel_for(0, n, [&](std::size_t i) {
+			auto node = g.node(i);
+			node.position() = x0_[i] + (dt / 6) * dx_[i];
+			node.value().velocity = v0_[i] + (dt / 6) * dv_[i];
+		});
+		return t + dt;
+	}
+
+	// Nothing is carried between steps
+	std::vector<point_type>& state() {
+		return state_;
+	}
+
+	private:
+	std::vector<point_type> state_;
+	// State at the start of the step
+	std::vector<point_type> x0_, v0_;
+	// Weighted sums of the stage slopes
+	std::vector<point_type> dx_, dv_;
+	// Slope of the most recent stage
+	std::vector<point_type> xs_, vs_;
+};
+
+#endif
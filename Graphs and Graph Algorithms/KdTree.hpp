@@ -0,0 +1,363 @@
+#ifndef KD_TREE_HPP
+#define KD_TREE_HPP
+
+/** @file KdTree.hpp
+ * @brief k-d tree over node positions for nearest-node and range queries.
+ *
+ * The tree is implicit: the points are stored in one array in tree order,
+ * the range [b, e) is a subtree, its median (b + e) / 2 is the splitting
+ * point, and [b, mid) and [mid + 1, e) are its children. Each subtree
+ * splits along the axis where its points spread most. Small subtrees are
+ * scanned as leaves.
+ *
+ * Moving a node does not restructure the tree. Its old slot is marked
+ * stale and skipped, and the node joins a short list of loose nodes that
+ * every query scans. The tree is rebuilt once that list grows past a
+ * fraction of the nodes, so a simulation can call update() every step.
+ *
+ * @code
+ * KdTree<Point> index(node_positions(g));
+ * int root = index.nearest(Point(-1, 0, 1));
+ * @endcode
+ */
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include "Parallel.hpp"
+#include "Point.hpp"
+
+/** Spatial index over the positions of nodes 0 ... size()-1.
+ * @tparam P Point type with operator[] for the 3 coordinates and normSq()
+ *
+ * RI: ids_ is a permutation of the nodes, slot_[ids_[k]] == k
+ * RI: stale_[k] iff node ids_[k] has moved since the last build, and then
+ * 	ids_[k] is in loose_
+ */
+template <typename P = Point>
+class KdTree {
+	typedef typename P::value_type scalar;
+
+	public:
+
+	// Subtrees with at most this many points are scanned linearly
+	static const int leaf_size = 8;
+
+	KdTree() {
+	}
+
+	explicit KdTree(const std::vector<P>& x) {
+		build(x);
+	}
+
+	/** Rebuilds the tree over the positions @a x, by node index.
+	 * The top levels split their ranges in parallel one level at a time,
+	 * then the resulting subtrees are built in parallel.
+	 */
+	void build(const std::vector<P>& x) {
+		x_ = x;
+		int n = x_.size();
+		ids_.resize(n);
+		for(int i = 0; i < n; ++i)
+			ids_[i] = i;
+		axis_.assign(n, 0);
+
+		std::vector<std::pair<int, int> > ranges(1, std::make_pair(0, n));
+		std::vector<std::pair<int, int> > next;
+		std::size_t enough = 4 * num_threads();
+		while( !ranges.empty() && ranges.size() < enough ) {
+			parallel_for(0, ranges.size(), [&](std::size_t k) {
+				split_(ranges[k].first, ranges[k].second);
+			}, 1);
+			next.clear();
+			for(std::size_t k = 0; k < ranges.size(); ++k) {
+				int b = ranges[k].first, e = ranges[k].second;
+				int mid = b + (e - b) / 2;
+				if( e - b > leaf_size ) {
+					next.push_back(std::make_pair(b, mid));
+					next.push_back(std::make_pair(mid + 1, e));
+				}
+			}
+			ranges.swap(next);
+		}
+		parallel_for(0, ranges.size(), [&](std::size_t k) {
+			build_(ranges[k].first, ranges[k].second);
+		}, 1);
+
+		points_.resize(n);
+		slot_.resize(n);
+		parallel_for(0, n, [&](std::size_t k) {
+			points_[k] = x_[ids_[k]];
+			slot_[ids_[k]] = k;
+		}, 4096);
+		stale_.assign(n, 0);
+		loose_.clear();
+	}
+
+	// Builds the tree over the node positions of Graph @a g
+	template <typename G>
+	void build_graph(G& g) {
+		std::vector<P> x;
+		x.reserve(g.num_nodes());
+		for(auto it = g.node_begin(); it != g.node_end(); ++it)
+			x.push_back((*it).position());
+		build(x);
+	}
+
+	// Returns the number of indexed nodes
+	std::size_t size() const {
+		return x_.size();
+	}
+
+	// Returns the indexed position of node @a i
+	const P& position(int i) const {
+		return x_[i];
+	}
+
+	/** Moves node @a i to @a x.
+	 * Queries see the new position at once; the tree is rebuilt when too
+	 * many nodes have moved.
+	 */
+	void move(int i, const P& x) {
+		x_[i] = x;
+		loosen_(i);
+		if( loose_.size() > max_loose_() )
+			build(x_);
+	}
+
+	/** Appends a node at @a x and returns its index, size() - 1. */
+	int add(const P& x) {
+		x_.push_back(x);
+		slot_.push_back(-1);
+		loose_.push_back(x_.size() - 1);
+		if( loose_.size() > max_loose_() )
+			build(x_);
+		return x_.size() - 1;
+	}
+
+	/** Brings the index up to date with the positions @a x, by node index.
+	 * Finds the nodes that moved in parallel; rebuilds if the number of
+	 * nodes changed or too many moved.
+	 */
+	void update(const std::vector<P>& x) {
+		if( x.size() != x_.size() ) {
+			build(x);
+			return;
+		}
+		std::vector<std::vector<int> > moved(num_threads());
+		parallel_for_chunks(0, x.size(),
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			for(std::size_t i = b; i < e; ++i)
+				if( x[i] != x_[i] )
+					moved[w].push_back(i);
+		}, 4096);
+		std::size_t count = 0;
+		for(std::size_t w = 0; w < moved.size(); ++w)
+			count += moved[w].size();
+		if( loose_.size() + count > max_loose_() ) {
+			build(x);
+			return;
+		}
+		for(std::size_t w = 0; w < moved.size(); ++w) {
+			for(std::size_t k = 0; k < moved[w].size(); ++k) {
+				int i = moved[w][k];
+				x_[i] = x[i];
+				loosen_(i);
+			}
+		}
+	}
+
+	/** Returns the node nearest to @a q, or -1 if the index is empty. */
+	int nearest(const P& q) const {
+		int best = -1;
+		scalar best_d2 = std::numeric_limits<scalar>::max();
+		nearest_(0, points_.size(), q, best, best_d2);
+		for(std::size_t k = 0; k < loose_.size(); ++k) {
+			scalar d2 = normSq(x_[loose_[k]] - q);
+			if( d2 < best_d2 ) {
+				best_d2 = d2;
+				best = loose_[k];
+			}
+		}
+		return best;
+	}
+
+	/** Returns the @a k nodes nearest to @a q, nearest first, or all the
+	 * nodes if there are fewer than @a k.
+	 */
+	std::vector<int> nearest(const P& q, std::size_t k) const {
+		std::vector<std::pair<scalar, int> > heap;
+		if( k == 0 )
+			return std::vector<int>();
+		k_nearest_(0, points_.size(), q, k, heap);
+		for(std::size_t j = 0; j < loose_.size(); ++j)
+			offer_(normSq(x_[loose_[j]] - q), loose_[j], k, heap);
+		std::sort_heap(heap.begin(), heap.end());
+		std::vector<int> result(heap.size());
+		for(std::size_t j = 0; j < heap.size(); ++j)
+			result[j] = heap[j].second;
+		return result;
+	}
+
+	/** Returns the nodes within distance @a r of @a q, in no particular
+	 * order.
+	 */
+	std::vector<int> within(const P& q, scalar r) const {
+		std::vector<int> result;
+		within_(0, points_.size(), q, r * r, result);
+		for(std::size_t k = 0; k < loose_.size(); ++k)
+			if( normSq(x_[loose_[k]] - q) <= r * r )
+				result.push_back(loose_[k]);
+		return result;
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	// Current positions, by node index
+	std::vector<P> x_;
+	// Positions at the last build and node indices, in tree order
+	std::vector<P> points_;
+	std::vector<int> ids_;
+	// Split axis of the subtree whose median is at slot k
+	std::vector<unsigned char> axis_;
+	// Tree slot of each node, -1 for nodes added since the last build
+	std::vector<int> slot_;
+	std::vector<char> stale_;
+	// Nodes whose position is not the one in the tree
+	std::vector<int> loose_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	std::size_t max_loose_() const {
+		return std::max<std::size_t>(64, x_.size() / 32);
+	}
+
+	void loosen_(int i) {
+		int k = slot_[i];
+		if( k >= 0 && !stale_[k] ) {
+			stale_[k] = 1;
+			loose_.push_back(i);
+		}
+	}
+
+	/** Picks the axis of largest spread of [b, e) and partitions ids_ so
+	 * the median is at the middle slot.
+	 */
+	void split_(int b, int e) {
+		if( e - b <= leaf_size )
+			return;
+		P lo = x_[ids_[b]], hi = lo;
+		for(int k = b + 1; k < e; ++k) {
+			const P& p = x_[ids_[k]];
+			for(int d = 0; d < 3; ++d) {
+				lo[d] = std::min(lo[d], p[d]);
+				hi[d] = std::max(hi[d], p[d]);
+			}
+		}
+		int a = 0;
+		for(int d = 1; d < 3; ++d)
+			if( hi[d] - lo[d] > hi[a] - lo[a] )
+				a = d;
+		int mid = b + (e - b) / 2;
+		axis_[mid] = a;
+		std::nth_element(ids_.begin() + b, ids_.begin() + mid, ids_.begin() + e,
+						 [&](int i, int j) { return x_[i][a] < x_[j][a]; });
+	}
+
+	void build_(int b, int e) {
+		if( e - b <= leaf_size )
+			return;
+		split_(b, e);
+		int mid = b + (e - b) / 2;
+		build_(b, mid);
+		build_(mid + 1, e);
+	}
+
+	void nearest_(int b, int e, const P& q, int& best, scalar& best_d2) const {
+		if( e - b <= leaf_size ) {
+			for(int k = b; k < e; ++k) {
+				scalar d2 = normSq(points_[k] - q);
+				if( d2 < best_d2 && !stale_[k] ) {
+					best_d2 = d2;
+					best = ids_[k];
+				}
+			}
+			return;
+		}
+		int mid = b + (e - b) / 2;
+		scalar d2 = normSq(points_[mid] - q);
+		if( d2 < best_d2 && !stale_[mid] ) {
+			best_d2 = d2;
+			best = ids_[mid];
+		}
+		scalar diff = q[axis_[mid]] - points_[mid][axis_[mid]];
+		if( diff < 0 ) {
+			nearest_(b, mid, q, best, best_d2);
+			if( diff * diff < best_d2 )
+				nearest_(mid + 1, e, q, best, best_d2);
+		} else {
+			nearest_(mid + 1, e, q, best, best_d2);
+			if( diff * diff < best_d2 )
+				nearest_(b, mid, q, best, best_d2);
+		}
+	}
+
+	// Keeps the k nearest candidates in a max-heap on squared distance
+	static void offer_(scalar d2, int id, std::size_t k,
+					   std::vector<std::pair<scalar, int> >& heap) {
+		if( heap.size() < k ) {
+			heap.push_back(std::make_pair(d2, id));
+			std::push_heap(heap.begin(), heap.end());
+		} else if( d2 < heap.front().first ) {
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = std::make_pair(d2, id);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	void k_nearest_(int b, int e, const P& q, std::size_t k,
+					std::vector<std::pair<scalar, int> >& heap) const {
+		if( e - b <= leaf_size ) {
+			for(int j = b; j < e; ++j)
+				if( !stale_[j] )
+					offer_(normSq(points_[j] - q), ids_[j], k, heap);
+			return;
+		}
+		int mid = b + (e - b) / 2;
+		if( !stale_[mid] )
+			offer_(normSq(points_[mid] - q), ids_[mid], k, heap);
+		scalar diff = q[axis_[mid]] - points_[mid][axis_[mid]];
+		int near_b = diff < 0 ? b : mid + 1, near_e = diff < 0 ? mid : e;
+		int far_b = diff < 0 ? mid + 1 : b, far_e = diff < 0 ? e : mid;
+		k_nearest_(near_b, near_e, q, k, heap);
+		if( heap.size() < k || diff * diff < heap.front().first )
+			k_nearest_(far_b, far_e, q, k, heap);
+	}
+
+	void within_(int b, int e, const P& q, scalar r2,
+				 std::vector<int>& result) const {
+		if( e - b <= leaf_size ) {
+			for(int k = b; k < e; ++k)
+				if( !stale_[k] && normSq(points_[k] - q) <= r2 )
+					result.push_back(ids_[k]);
+			return;
+		}
+		int mid = b + (e - b) / 2;
+		if( !stale_[mid] && normSq(points_[mid] - q) <= r2 )
+			result.push_back(ids_[mid]);
+		scalar diff = q[axis_[mid]] - points_[mid][axis_[mid]];
+		if( diff <= 0 || diff * diff <= r2 )
+			within_(b, mid, q, r2, result);
+		if( diff >= 0 || diff * diff <= r2 )
+			within_(mid + 1, e, q, r2, result);
+	}
+};
+
+#endif
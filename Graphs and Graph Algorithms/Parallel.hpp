@@ -0,0 +1,204 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+/** @file Parallel.hpp
+ * @brief A persistent thread pool and parallel loops over index ranges.
+ *
+ * @code
+ * // Scale every entry of a vector on all cores
+ * parallel_for(0, v.size(), [&](std::size_t i) { v[i] *= 2; });
+ * @endcode
+ *
+ * The number of threads defaults to std::thread::hardware_concurrency()
+ * and can be overridden with the CS207_NUM_THREADS environment variable.
+ * A parallel loop started from inside another parallel loop runs serially
+ * on the calling thread.
+ */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+
+class ThreadPool {
+	public:
+
+	// Type of the function run on each chunk: (begin, end, worker id)
+	typedef std::function<void(std::size_t, std::size_t, unsigned)> chunk_fn;
+
+	// Returns the pool shared by the whole program.
+	static ThreadPool& instance() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+	// Returns the number of threads that run a loop, including the caller.
+	unsigned size() const {
+		return workers_.size() + 1;
+	}
+
+	/** Runs @a f over [begin, end) split into chunks of @a grain indices.
+	 * @param[in] f Called as f(b, e, w) for each chunk [b, e), where
+	 * 	0 <= w < size() identifies the thread running the chunk.
+	 * @post Every chunk has been run when this returns.
+	 *
+	 * Chunks are handed out dynamically, so uneven work balances itself.
+	 */
+	void run(std::size_t begin, std::size_t end, std::size_t grain,
+			 const chunk_fn& f) {
+		if( begin >= end )
+			return;
+		grain = std::max<std::size_t>(grain, 1);
+		// Serial fallback for small loops, nested loops and one thread
+		if( workers_.empty() || in_loop_() || end - begin <= grain ) {
+			bool outer = in_loop_();
+			in_loop_() = true;
+			f(begin, end, 0);
+			in_loop_() = outer;
+			return;
+		}
+
+		// One loop at a time when several threads share the pool
+		std::lock_guard<std::mutex> exclusive(run_mutex_);
+		std::unique_lock<std::mutex> lock(mutex_);
+		job_ = &f;
+		next_ = begin;
+		end_ = end;
+		grain_ = grain;
+		busy_ = workers_.size();
+		++generation_;
+		lock.unlock();
+		wake_.notify_all();
+
+		work_(0);
+
+		lock.lock();
+		done_.wait(lock, [this] { return busy_ == 0; });
+		job_ = NULL;
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for(auto it = workers_.begin(); it != workers_.end(); ++it)
+			it->join();
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	std::vector<std::thread> workers_;
+	std::mutex run_mutex_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	// The loop currently being run
+	const chunk_fn* job_;
+	std::atomic<std::size_t> next_;
+	std::size_t end_;
+	std::size_t grain_;
+
+	// Number of workers still running the current loop
+	std::size_t busy_;
+	unsigned long generation_;
+	bool stop_;
+
+	ThreadPool() : job_(NULL), next_(0), end_(0), grain_(1),
+				   busy_(0), generation_(0), stop_(false) {
+		unsigned n = std::thread::hardware_concurrency();
+		if( const char* env = std::getenv("CS207_NUM_THREADS") )
+			n = std::atoi(env);
+		n = std::max(n, 1u);
+		for(unsigned w = 1; w < n; ++w)
+			workers_.push_back(std::thread(&ThreadPool::loop_, this, w));
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	void operator=(const ThreadPool&) = delete;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	// True on a thread that is currently running a chunk
+	static bool& in_loop_() {
+		static thread_local bool flag = false;
+		return flag;
+	}
+
+	// Claims and runs chunks of the current loop until none are left.
+	void work_(unsigned w) {
+		in_loop_() = true;
+		while(1) {
+			std::size_t b = next_.fetch_add(grain_);
+			if( b >= end_ )
+				break;
+			(*job_)(b, std::min(b + grain_, end_), w);
+		}
+		in_loop_() = false;
+	}
+
+	// Body of each worker thread
+	void loop_(unsigned w) {
+		unsigned long seen = 0;
+		while(1) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+				if( stop_ )
+					return;
+				seen = generation_;
+			}
+			work_(w);
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				--busy_;
+			}
+			done_.notify_one();
+		}
+	}
+};
+
+// Returns the number of threads used by parallel loops.
+inline unsigned num_threads() {
+	return ThreadPool::instance().size();
+}
+
+/** Calls @a f(i) for every i in [begin, end) in parallel.
+ * @pre Calls with different i must be safe to run concurrently.
+ */
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, F f,
+				  std::size_t grain = 256) {
+	ThreadPool::instance().run(begin, end, grain,
+		[&f](std::size_t b, std::size_t e, unsigned) {
+			for(std::size_t i = b; i < e; ++i)
+				f(i);
+		});
+}
+
+/** Calls @a f(b, e, w) on chunks [b, e) covering [begin, end) in parallel.
+ * w identifies the thread, 0 <= w < num_threads(), and can index per-thread
+ * scratch space or partial results.
+ */
+template <typename F>
+void parallel_for_chunks(std::size_t begin, std::size_t end, F f,
+						 std::size_t grain = 256) {
+	ThreadPool::instance().run(begin, end, grain,
+		[&f](std::size_t b, std::size_t e, unsigned w) {
+			f(b, e, w);
+		});
+}
+
+#endif
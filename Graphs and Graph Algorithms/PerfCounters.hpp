@@ -0,0 +1,198 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+/** @file PerfCounters.hpp
+ * @brief Hardware event counters of the calling thread via perf_event_open.
+ *
+ * @code
+ * PerfCounters counters;
+ * PerfSample before = counters.read();
+ * // code to measure
+ * PerfSample d = counters.read() - before;
+ * double ipc = d.ipc();
+ * @endcode
+ *
+ * Counts cycles, instructions, last-level cache misses and branch misses
+ * in user space. A PerfCounters counts only the thread that created it;
+ * PoolPerfCounters opens one on every thread of the pool and reads their
+ * sum, so work handed to parallel loops is counted on whichever thread
+ * ran it.
+ *
+ * Counters that cannot be opened (no perf support, a restrictive
+ * perf_event_paranoid, a VM without a PMU, or CS207_PERF=0) read as
+ * unavailable and everything else keeps working.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "Parallel.hpp"
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+/** Cumulative counts of the events of a PerfCounters. */
+struct PerfSample {
+	enum { cycles, instructions, llc_misses, branch_misses, num_events };
+
+	uint64_t value[num_events];
+	bool valid[num_events];
+
+	PerfSample() {
+		for(int k = 0; k < num_events; ++k) {
+			value[k] = 0;
+			valid[k] = false;
+		}
+	}
+
+	static const char* name(int k) {
+		static const char* names[num_events] = {
+			"cycles", "instructions", "llc_misses", "branch_misses"};
+		return names[k];
+	}
+
+	PerfSample operator-(const PerfSample& b) const {
+		PerfSample d;
+		for(int k = 0; k < num_events; ++k) {
+			d.valid[k] = valid[k] && b.valid[k];
+			d.value[k] = value[k] - b.value[k];
+		}
+		return d;
+	}
+
+	PerfSample& operator+=(const PerfSample& b) {
+		for(int k = 0; k < num_events; ++k) {
+			valid[k] = valid[k] && b.valid[k];
+			value[k] += b.value[k];
+		}
+		return *this;
+	}
+
+	// Instructions per cycle, or 0 if either count is unavailable
+	double ipc() const {
+		if( !valid[cycles] || !valid[instructions] || value[cycles] == 0 )
+			return 0;
+		return double(value[instructions]) / value[cycles];
+	}
+};
+
+class PerfCounters {
+	public:
+
+	// Opens and starts every counter that the system allows
+	PerfCounters() {
+		for(int k = 0; k < PerfSample::num_events; ++k)
+			fd_[k] = -1;
+		const char* env = std::getenv("CS207_PERF");
+		if( env && std::string(env) == "0" )
+			return;
+#ifdef __linux__
+		static const uint64_t config[PerfSample::num_events] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+		for(int k = 0; k < PerfSample::num_events; ++k) {
+			struct perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config[k];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd_[k] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+
+	~PerfCounters() {
+#ifdef __linux__
+		for(int k = 0; k < PerfSample::num_events; ++k)
+			if( fd_[k] >= 0 )
+				close(fd_[k]);
+#endif
+	}
+
+	// Returns true if at least one counter is running
+	bool available() const {
+		for(int k = 0; k < PerfSample::num_events; ++k)
+			if( fd_[k] >= 0 )
+				return true;
+		return false;
+	}
+
+	// Returns the counts since construction; unavailable counters read 0
+	PerfSample read() const {
+		PerfSample s;
+#ifdef __linux__
+		for(int k = 0; k < PerfSample::num_events; ++k) {
+			uint64_t v;
+			if( fd_[k] >= 0 && ::read(fd_[k], &v, sizeof(v)) == sizeof(v) ) {
+				s.value[k] = v;
+				s.valid[k] = true;
+			}
+		}
+#endif
+		return s;
+	}
+
+	private:
+	int fd_[PerfSample::num_events];
+
+	PerfCounters(const PerfCounters&) = delete;
+	void operator=(const PerfCounters&) = delete;
+};
+
+/** Counters of every thread of the pool, read as one sum.
+ * A count is valid only if it could be read on every thread, so a sample
+ * never leaves out part of the work.
+ */
+class PoolPerfCounters {
+	public:
+
+	/** Opens a PerfCounters on each thread of the pool.
+	 * @pre Not called from inside a parallel loop, where only the calling
+	 * 	thread would run
+	 */
+	PoolPerfCounters() : counters_(num_threads()) {
+		std::size_t threads = counters_.size();
+		std::atomic<std::size_t> started(0);
+		// Every chunk waits until all have started, so no thread can take
+		// two and each opens its own counters
+		parallel_for_chunks(0, threads, [&](std::size_t b, std::size_t e, unsigned w) {
+			started += e - b;
+			while( started.load() < threads )
+				std::this_thread::yield();
+			counters_[w].reset(new PerfCounters());
+		}, 1);
+	}
+
+	// Returns true if at least one counter is running on every thread
+	bool available() const {
+		for(std::size_t t = 0; t < counters_.size(); ++t)
+			if( !counters_[t] || !counters_[t]->available() )
+				return false;
+		return true;
+	}
+
+	// Returns the counts of all threads since construction
+	PerfSample read() const {
+		PerfSample s;
+		for(int k = 0; k < PerfSample::num_events; ++k)
+			s.valid[k] = true;
+		for(std::size_t t = 0; t < counters_.size(); ++t)
+			s += counters_[t] ? counters_[t]->read() : PerfSample();
+		return s;
+	}
+
+	private:
+	std::vector<std::unique_ptr<PerfCounters> > counters_;
+};
+
+#endif
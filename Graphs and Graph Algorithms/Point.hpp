@@ -5,100 +5,111 @@
 #include <cmath>
 
 /** @file Point.hpp
- * @brief Define the Point class for 3D points.
+ * @brief Define the BasicPoint class template for 3D points, and Point, its
+ * double precision instance.
  */
 
 #define for_i for(std::size_t i = 0; i != 3; ++i)
 
-/** @class Point
- * @brief Class representing 3D points and vectors.
+/** @class BasicPoint
+ * @brief Class representing 3D points and vectors with components of
+ * scalar type T.
  *
- * Point contains methods that support use as points in 3D space, and
+ * BasicPoint contains methods that support use as points in 3D space, and
  * use as 3-dimensional vectors (that can, for example, be cross-producted).
  *
  * Its x, y, and z components are publicly accessible under those names. They
  * can also be accessed as coordinate[0], coordinate[1], and coordinate[2],
  * respectively.
+ *
+ * Point is BasicPoint<double>. Points of different scalar types convert
+ * only explicitly, so precision is never lost silently.
  */
-struct Point {
+template <typename T>
+struct BasicPoint {
   union {
     struct {
-      double x;
-      double y;
-      double z;
+      T x;
+      T y;
+      T z;
     };
-    double elem[3];
+    T elem[3];
   };
 
-  typedef double          value_type;
-  typedef double&         reference;
-  typedef const double&   const_reference;
-  typedef double*         iterator;
-  typedef const double*   const_iterator;
+  typedef T               value_type;
+  typedef T&              reference;
+  typedef const T&        const_reference;
+  typedef T*              iterator;
+  typedef const T*        const_iterator;
   typedef std::size_t     size_type;
   typedef std::ptrdiff_t  difference_type;
 
   // CONSTRUCTORS
 
-  Point() {
+  BasicPoint() {
     for_i elem[i] = value_type();
   }
-  explicit Point(value_type b) {
+  explicit BasicPoint(value_type b) {
     for_i elem[i] = b;
   }
-  Point(value_type b0, value_type b1, value_type b2) {
+  BasicPoint(value_type b0, value_type b1, value_type b2) {
     elem[0] = b0; elem[1] = b1; elem[2] = b2;
   }
+  /** Convert from a point of another scalar type */
+  template <typename U>
+  explicit BasicPoint(const BasicPoint<U>& b) {
+    for_i elem[i] = value_type(b[i]);
+  }
 
   // COMPARATORS
 
-  bool operator==(const Point& b) const {
+  bool operator==(const BasicPoint& b) const {
     for_i if (elem[i] != b[i]) return false;
     return true;
   }
-  bool operator!=(const Point& b) const {
+  bool operator!=(const BasicPoint& b) const {
     return !(*this == b);
   }
 
   // MODIFIERS
 
   /** Add scalar @a b to this Point */
-  Point& operator+=(value_type b) {
+  BasicPoint& operator+=(value_type b) {
     for_i elem[i] += b;
     return *this;
   }
   /** Subtract scalar @a b from this Point */
-  Point& operator-=(value_type b) {
+  BasicPoint& operator-=(value_type b) {
     for_i elem[i] -= b;
     return *this;
   }
   /** Scale this Point up by scalar @a b */
-  Point& operator*=(value_type b) {
+  BasicPoint& operator*=(value_type b) {
     for_i elem[i] *= b;
     return *this;
   }
   /** Scale this Point down by scalar @a b */
-  Point& operator/=(value_type b) {
+  BasicPoint& operator/=(value_type b) {
     for_i elem[i] /= b;
     return *this;
   }
   /** Add Point @a b to this Point */
-  Point& operator+=(const Point& b) {
+  BasicPoint& operator+=(const BasicPoint& b) {
     for_i elem[i] += b[i];
     return *this;
   }
   /** Subtract Point @a b from this Point */
-  Point& operator-=(const Point& b) {
+  BasicPoint& operator-=(const BasicPoint& b) {
     for_i elem[i] -= b[i];
     return *this;
   }
   /** Scale this Point up by factors in @a b */
-  Point& operator*=(const Point& b) {
+  BasicPoint& operator*=(const BasicPoint& b) {
     for_i elem[i] *= b[i];
     return *this;
   }
   /** Scale this Point down by factors in @a b */
-  Point& operator/=(const Point& b) {
+  BasicPoint& operator/=(const BasicPoint& b) {
     for_i elem[i] /= b[i];
     return *this;
   }
@@ -131,109 +142,135 @@ struct Point {
   const_iterator   cend() const { return elem+3; }
 };
 
+typedef BasicPoint<double> Point;
+
 // STREAM OPERATORS
 
 /** Write a Point to an output stream */
-std::ostream& operator<<(std::ostream& s, const Point& a) {
+template <typename T>
+std::ostream& operator<<(std::ostream& s, const BasicPoint<T>& a) {
   return (s << a.x << ' ' << a.y << ' ' << a.z);
 }
 /** Read a Vec from an input stream */
-std::istream& operator>>(std::istream& s, Point& a) {
+template <typename T>
+std::istream& operator>>(std::istream& s, BasicPoint<T>& a) {
   return (s >> a.x >> a.y >> a.z);
 }
 
 // ARITHMETIC OPERATORS
 
 /** Unary negation: Return -@a a */
-Point operator-(const Point& a) {
-  return Point(-a.x, -a.y, -a.z);
+template <typename T>
+BasicPoint<T> operator-(const BasicPoint<T>& a) {
+  return BasicPoint<T>(-a.x, -a.y, -a.z);
 }
 /** Unary plus: Return @a a. ("+a" should work if "-a" works.) */
-Point operator+(const Point& a) {
+template <typename T>
+BasicPoint<T> operator+(const BasicPoint<T>& a) {
   return a;
 }
-Point operator+(Point a, const Point& b) {
+template <typename T>
+BasicPoint<T> operator+(BasicPoint<T> a, const BasicPoint<T>& b) {
   return a += b;
 }
-Point operator+(Point a, double b) {
+template <typename T>
+BasicPoint<T> operator+(BasicPoint<T> a, typename BasicPoint<T>::value_type b) {
   return a += b;
 }
-Point operator+(double b, Point a) {
+template <typename T>
+BasicPoint<T> operator+(typename BasicPoint<T>::value_type b, BasicPoint<T> a) {
   return a += b;
 }
-Point operator-(Point a, const Point& b) {
+template <typename T>
+BasicPoint<T> operator-(BasicPoint<T> a, const BasicPoint<T>& b) {
   return a -= b;
 }
-Point operator-(Point a, double b) {
+template <typename T>
+BasicPoint<T> operator-(BasicPoint<T> a, typename BasicPoint<T>::value_type b) {
   return a -= b;
 }
-Point operator-(double b, const Point& a) {
+template <typename T>
+BasicPoint<T> operator-(typename BasicPoint<T>::value_type b, const BasicPoint<T>& a) {
   return (-a) += b;
 }
-Point operator*(Point a, const Point& b) {
+template <typename T>
+BasicPoint<T> operator*(BasicPoint<T> a, const BasicPoint<T>& b) {
   return a *= b;
 }
-Point operator*(Point a, double b) {
+template <typename T>
+BasicPoint<T> operator*(BasicPoint<T> a, typename BasicPoint<T>::value_type b) {
   return a *= b;
 }
-Point operator*(double b, Point a) {
+template <typename T>
+BasicPoint<T> operator*(typename BasicPoint<T>::value_type b, BasicPoint<T> a) {
   return a *= b;
 }
-Point operator/(Point a, const Point& b) {
+template <typename T>
+BasicPoint<T> operator/(BasicPoint<T> a, const BasicPoint<T>& b) {
   return a /= b;
 }
-Point operator/(Point a, double b) {
+template <typename T>
+BasicPoint<T> operator/(BasicPoint<T> a, typename BasicPoint<T>::value_type b) {
   return a /= b;
 }
 
 // NORMS AND MATH OPERATORS
 
 /** Compute cross product of two 3D Points */
-Point cross(const Point& a, const Point& b) {
-  return Point(a[1]*b[2] - a[2]*b[1],
-               a[2]*b[0] - a[0]*b[2],
-               a[0]*b[1] - a[1]*b[0]);
+template <typename T>
+BasicPoint<T> cross(const BasicPoint<T>& a, const BasicPoint<T>& b) {
+  return BasicPoint<T>(a[1]*b[2] - a[2]*b[1],
+                       a[2]*b[0] - a[0]*b[2],
+                       a[0]*b[1] - a[1]*b[0]);
 }
 
 /** Compute the inner product of two Points */
-double inner_prod(const Point& a, const Point& b) {
-  double v = 0;
+template <typename T>
+T inner_prod(const BasicPoint<T>& a, const BasicPoint<T>& b) {
+  T v = 0;
   for_i v += a[i]*b[i];
   return v;
 }
-double dot(const Point& a, const Point& b) {
+template <typename T>
+T dot(const BasicPoint<T>& a, const BasicPoint<T>& b) {
   return inner_prod(a,b);
 }
 
 /** Compute the squared L2 norm of a Point */
-double normSq(const Point& a) {
-  double v = 0;
+template <typename T>
+T normSq(const BasicPoint<T>& a) {
+  T v = 0;
   for_i v += a[i]*a[i];
   return v;
 }
 /** Compute the L2 norm of a Point */
-double norm(const Point& a) {
+template <typename T>
+T norm(const BasicPoint<T>& a) {
   return std::sqrt(normSq(a));
 }
-double norm_2(const Point& a) {
+template <typename T>
+T norm_2(const BasicPoint<T>& a) {
   return norm(a);
 }
 /** Compute the L1 norm of a Point */
-double norm_1(const Point& a) {
-  double v = 0;
+template <typename T>
+T norm_1(const BasicPoint<T>& a) {
+  T v = 0;
   for_i v += std::abs(a[i]);
   return v;
 }
 /** Compute the L-infinity norm of a Point */
-double norm_inf(const Point& a) {
-  double v = 0;
+template <typename T>
+T norm_inf(const BasicPoint<T>& a) {
+  T v = 0;
   for_i v = std::max(v, std::abs(a[i]));
   return v;
 }
 
 /** Custom helper function to return distance between points */
-float distance(const Point& a, const Point& b) {
-	return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2) + pow(a.z - b.z, 2));
+template <typename T>
+T distance(const BasicPoint<T>& a, const BasicPoint<T>& b) {
+	return norm(a - b);
 }
 
 #undef for_i
@@ -0,0 +1,269 @@
+#ifndef POINT_TO_POINT_HPP
+#define POINT_TO_POINT_HPP
+
+/** @file PointToPoint.hpp
+ * @brief Shortest path queries between two nodes of an Adjacency.
+ *
+ * A single-source search settles every node closer than the target. Two
+ * searches here stop early instead:
+ * - A* orders the nodes by dist + |position - target position|, so nodes
+ *   that lead away from the target are settled late or never. This needs
+ *   every edge to be at least as long as the straight line between its
+ *   nodes, which euclidean_weights() satisfies.
+ * - Bidirectional Dijkstra grows one search from the source and one from
+ *   the target and stops once the two tops together reach the best path
+ *   through a node seen by both. It works for any non-negative weights.
+ *
+ * Scratch arrays (SearchScratch) are allocated once per thread and reset
+ * only where the last query touched them, so a query costs time in the
+ * nodes it visits, not in the size of the graph.
+ *
+ * @code
+ * Adjacency adj = out_adjacency(g);
+ * std::vector<double> w = euclidean_weights(g, adj);
+ * std::vector<Point> x = node_positions(g);
+ * PointToPoint<double> p2p(adj, w, x);
+ * PathResult<double> r = p2p.astar(s, t);
+ * @endcode
+ */
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "Adjacency.hpp"
+#include "ShortestPath.hpp"
+#include "Parallel.hpp"
+#include "Point.hpp"
+
+/** Result of a point-to-point query.
+ * RI: path is empty iff the target was not reached, and then
+ * 	length == ShortestPathTree<D>::unreachable()
+ */
+template <typename D>
+struct PathResult {
+	D length;
+	std::vector<int> path;  //< Node indices from source to target
+	std::size_t settled;    //< Nodes taken from the heaps
+
+	bool found() const {
+		return !path.empty();
+	}
+};
+
+/** Returns the position of every node of @a g by node index. */
+template <typename G>
+std::vector<typename G::point_type> node_positions(G& g) {
+	std::vector<typename G::point_type> x;
+	x.reserve(g.num_nodes());
+	for(auto it = g.node_begin(); it != g.node_end(); ++it)
+		x.push_back((*it).position());
+	return x;
+}
+
+/** Point-to-point shortest paths over a fixed Adjacency and weights.
+ * @tparam D Distance type
+ * @tparam P Position type, with norm(P - P)
+ *
+ * Queries on one object must not run concurrently, except through batch(),
+ * which gives every thread its own scratch.
+ */
+template <typename D, typename P = Point>
+class PointToPoint {
+	public:
+
+	enum Method { use_astar, use_bidirectional };
+
+	/** Constructor for an undirected graph.
+	 * @param[in] weight   Non-negative length of each adjacency entry
+	 * @param[in] position Node positions by index, used by astar() only
+	 */
+	PointToPoint(const Adjacency& adj, const std::vector<D>& weight,
+				 const std::vector<P>& position)
+			: PointToPoint(adj, weight, adj, weight, position) {
+	}
+
+	/** Constructor for a directed graph, given its out_adjacency() and
+	 * in_adjacency() with a weight per entry of each.
+	 */
+	PointToPoint(const Adjacency& out, const std::vector<D>& out_weight,
+				 const Adjacency& in, const std::vector<D>& in_weight,
+				 const std::vector<P>& position)
+			: out_(out), out_weight_(out_weight), in_(in),
+			  in_weight_(in_weight), position_(position), scratch_(2) {
+	}
+
+	/** A* search from @a source to @a target.
+	 * @pre Each edge is at least as long as the distance between the
+	 * 	positions of its nodes.
+	 */
+	PathResult<D> astar(int source, int target) {
+		return astar_(source, target, scratch_[0]);
+	}
+
+	// Bidirectional Dijkstra from @a source to @a target
+	PathResult<D> bidirectional(int source, int target) {
+		return bidirectional_(source, target, scratch_[0], scratch_[1]);
+	}
+
+	/** Answers every (source, target) pair of @a queries in parallel.
+	 * @returns The result of queries[k] at index k
+	 */
+	std::vector<PathResult<D> > batch(
+			const std::vector<std::pair<int, int> >& queries, Method method) {
+		std::vector<PathResult<D> > results(queries.size());
+		unsigned threads = num_threads();
+		if( scratch_.size() < 2 * threads )
+			scratch_.resize(2 * threads);
+		parallel_for_chunks(0, queries.size(),
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			Scratch& forward = scratch_[2 * w];
+			Scratch& backward = scratch_[2 * w + 1];
+			for(std::size_t k = b; k < e; ++k) {
+				int s = queries[k].first;
+				int t = queries[k].second;
+				if( method == use_astar )
+					results[k] = astar_(s, t, forward);
+				else
+					results[k] = bidirectional_(s, t, forward, backward);
+			}
+		}, 1);
+		return results;
+	}
+
+	private:
+
+	typedef SearchScratch<D> Scratch;
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	const Adjacency& out_;
+	const std::vector<D>& out_weight_;
+	const Adjacency& in_;
+	const std::vector<D>& in_weight_;
+	const std::vector<P>& position_;
+	// Two per thread: forward and backward
+	std::vector<Scratch> scratch_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	static PathResult<D> not_found_(std::size_t settled) {
+		PathResult<D> r;
+		r.length = ShortestPathTree<D>::unreachable();
+		r.settled = settled;
+		return r;
+	}
+
+	D heuristic_(int v, int target) const {
+		return D(norm(position_[v] - position_[target]));
+	}
+
+	PathResult<D> astar_(int source, int target, Scratch& s) {
+		s.prepare(out_.num_nodes());
+		s.label(source, 0, -1);
+		s.heap.push(source, heuristic_(source, target));
+		std::size_t settled = 0;
+		bool found = false;
+		while( !s.heap.empty() ) {
+			int u = s.heap.pop();
+			++settled;
+			if( u == target ) {
+				found = true;
+				break;
+			}
+			D du = s.dist[u];
+			for(int k = out_.begin(u); k < out_.end(u); ++k) {
+				int v = out_.targets[k];
+				D dv = du + out_weight_[k];
+				if( dv < s.dist[v] ) {
+					s.label(v, dv, u);
+					s.heap.push(v, dv + heuristic_(v, target));
+				}
+			}
+		}
+		if( !found ) {
+			s.clear();
+			return not_found_(settled);
+		}
+		PathResult<D> r;
+		r.length = s.dist[target];
+		r.settled = settled;
+		for(int i = target; i >= 0; i = s.pred[i])
+			r.path.push_back(i);
+		std::reverse(r.path.begin(), r.path.end());
+		s.clear();
+		return r;
+	}
+
+	/** Settles the top of @a s, relaxing along @a adj, and lowers @a best
+	 * when a relaxed node has been labeled by the other search @a t.
+	 */
+	void step_(Scratch& s, const Adjacency& adj, const std::vector<D>& weight,
+			   const Scratch& t, D& best, int& meet) {
+		int u = s.heap.pop();
+		D du = s.dist[u];
+		for(int k = adj.begin(u); k < adj.end(u); ++k) {
+			int v = adj.targets[k];
+			D dv = du + weight[k];
+			if( dv < s.dist[v] ) {
+				s.label(v, dv, u);
+				s.heap.push(v, dv);
+			}
+			if( t.dist[v] != ShortestPathTree<D>::unreachable() &&
+				dv + t.dist[v] < best ) {
+				best = dv + t.dist[v];
+				meet = v;
+			}
+		}
+	}
+
+	PathResult<D> bidirectional_(int source, int target, Scratch& f, Scratch& b) {
+		if( source == target ) {
+			PathResult<D> r;
+			r.length = 0;
+			r.path.assign(1, source);
+			r.settled = 0;
+			return r;
+		}
+		f.prepare(out_.num_nodes());
+		b.prepare(in_.num_nodes());
+		f.label(source, 0, -1);
+		f.heap.push(source, 0);
+		b.label(target, 0, -1);
+		b.heap.push(target, 0);
+
+		D best = ShortestPathTree<D>::unreachable();
+		int meet = -1;
+		std::size_t settled = 0;
+		// Any path not yet seen is at least as long as the two tops together
+		while( !f.heap.empty() && !b.heap.empty() &&
+			   f.heap.top_key() + b.heap.top_key() < best ) {
+			++settled;
+			if( f.heap.size() <= b.heap.size() )
+				step_(f, out_, out_weight_, b, best, meet);
+			else
+				step_(b, in_, in_weight_, f, best, meet);
+		}
+		if( meet < 0 ) {
+			f.clear();
+			b.clear();
+			return not_found_(settled);
+		}
+		PathResult<D> r;
+		r.length = best;
+		r.settled = settled;
+		for(int i = meet; i >= 0; i = f.pred[i])
+			r.path.push_back(i);
+		std::reverse(r.path.begin(), r.path.end());
+		for(int i = b.pred[meet]; i >= 0; i = b.pred[i])
+			r.path.push_back(i);
+		f.clear();
+		b.clear();
+		return r;
+	}
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef POSITION_BASED_DYNAMICS_HPP
+#define POSITION_BASED_DYNAMICS_HPP
+
+/** @file PositionBasedDynamics.hpp
+ * @brief Position-based dynamics with one distance constraint per edge.
+ *
+ * Every edge of the graph keeps its endpoints at the rest length stored
+ * in the edge value. Constraints are projected with Gauss-Seidel sweeps;
+ * the edges are colored so that no two edges of a color share a node, and
+ * each color class is projected in parallel.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "Point.hpp"
+#include "Parallel.hpp"
+
+/** Position-based dynamics solver for a Graph.
+ * @tparam G Graph type. G::node_value_type must have a G::point_type
+ * 	velocity and a mass; G::edge_value_type must convert to the rest length.
+ *
+ * RI: constraints_ is sorted by color and the constraints of color c are
+ * 	constraints_[color_begin_[c]] ... constraints_[color_begin_[c+1] - 1]
+ * RI: No two constraints of the same color share a node index.
+ */
+template <typename G>
+class PositionBasedDynamics {
+
+	typedef typename G::node_type node_type;
+	typedef typename G::edge_type edge_type;
+	typedef typename G::point_type point_type;
+
+	// Distance constraint between node indices i and j
+	struct DistanceConstraint {
+		int i;
+		int j;
+		double rest;
+	};
+
+	public:
+
+	/** Constructs a solver.
+	 * @param[in] iterations Gauss-Seidel sweeps per time step
+	 * @param[in] stiffness  Fraction of each constraint error corrected
+	 * 	per projection, in (0, 1]
+	 */
+	PositionBasedDynamics(int iterations = 10, double stiffness = 1.0)
+			: iterations_(iterations), stiffness_(stiffness),
+			  num_nodes_(0), num_edges_(0) {
+	}
+
+	/** Advances the graph by one time step.
+	 * @param[in,out] g     Graph
+	 * @param[in]     t     The current time
+	 * @param[in]     dt    The time step
+	 * @param[in]     force Function object called as force(n, t) returning
+	 * 	the external force on node n (gravity, damping, ...). Springs are
+	 * 	modelled by the constraints and must not be included.
+	 * @param[in]     fixed Predicate called as fixed(n); fixed nodes never
+	 * 	move.
+	 * @return the next time step @a t + @a dt
+	 *
+	 * The constraint coloring is rebuilt whenever the number of nodes or
+	 * edges of @a g changes.
+	 */
+	template <typename F, typename C>
+	double step(G& g, double t, double dt, F force, C fixed) {
+		if( g.num_nodes() != num_nodes_ || g.num_edges() != num_edges_ )
+			build_(g);
+		std::size_t n = num_nodes_;
+
+		// Predict positions from the external forces
+		parallel_for(0, n, [&](std::size_t i) {
+			node_type node = g.node(i);
+			inv_mass_[i] = fixed(node) ? 0 : 1 / node.value().mass;
+			node.value().velocity += force(node, t) * (dt * inv_mass_[i]);
+			if( inv_mass_[i] == 0 )
+				node.value().velocity = point_type(0, 0, 0);
+			x_[i] = node.position();
+			p_[i] = x_[i] + node.value().velocity * dt;
+		});
+
+		// Project the constraints, one color class at a time
+		for(int it = 0; it < iterations_; ++it) {
+			for(std::size_t c = 0; c + 1 < color_begin_.size(); ++c) {
+				parallel_for(color_begin_[c], color_begin_[c + 1],
+							 [&](std::size_t k) { project_(constraints_[k]); });
+			}
+		}
+
+		// Derive velocities from the corrected positions
+		parallel_for(0, n, [&](std::size_t i) {
+			node_type node = g.node(i);
+			node.value().velocity = (p_[i] - x_[i]) / dt;
+			node.position() = p_[i];
+		});
+		return t + dt;
+	}
+
+	// Returns the number of colors used for the current constraints.
+	std::size_t num_colors() const {
+		return color_begin_.empty() ? 0 : color_begin_.size() - 1;
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	int iterations_;
+	double stiffness_;
+
+	// Size of the graph the constraints were built for
+	std::size_t num_nodes_;
+	std::size_t num_edges_;
+
+	std::vector<DistanceConstraint> constraints_;
+	std::vector<std::size_t> color_begin_;
+
+	// Per-node state indexed by node index
+	std::vector<point_type> x_;
+	std::vector<point_type> p_;
+	std::vector<double> inv_mass_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	// Moves the endpoints of @a c towards its rest length.
+	void project_(const DistanceConstraint& c) {
+		double w = inv_mass_[c.i] + inv_mass_[c.j];
+		if( w == 0 )
+			return;
+		point_type d = p_[c.i] - p_[c.j];
+		double len = norm(d);
+		if( len == 0 )
+			return;
+		point_type corr = (stiffness_ * (len - c.rest) / (w * len)) * d;
+		p_[c.i] -= inv_mass_[c.i] * corr;
+		p_[c.j] += inv_mass_[c.j] * corr;
+	}
+
+	/** Builds one constraint per edge and colors them greedily.
+	 * Each edge gets the smallest color not yet used at either endpoint,
+	 * then the constraints are bucketed by color.
+	 */
+	void build_(G& g) {
+		num_nodes_ = g.num_nodes();
+		num_edges_ = g.num_edges();
+		x_.resize(num_nodes_);
+		p_.resize(num_nodes_);
+		inv_mass_.resize(num_nodes_);
+
+		std::vector<std::vector<int> > used(num_nodes_);
+		std::vector<DistanceConstraint> uncolored;
+		std::vector<int> colors;
+		std::vector<std::size_t> count;
+		for(auto it = g.edge_begin(); it != g.edge_end(); ++it) {
+			edge_type e = *it;
+			DistanceConstraint c;
+			c.i = e.node1().index();
+			c.j = e.node2().index();
+			c.rest = e.value();
+			int color = 0;
+			while( std::count(used[c.i].begin(), used[c.i].end(), color) ||
+				   std::count(used[c.j].begin(), used[c.j].end(), color) )
+				++color;
+			used[c.i].push_back(color);
+			used[c.j].push_back(color);
+			uncolored.push_back(c);
+			colors.push_back(color);
+			if( color >= (int) count.size() )
+				count.resize(color + 1, 0);
+			++count[color];
+		}
+
+		// Counting sort of the constraints by color
+		color_begin_.assign(count.size() + 1, 0);
+		for(std::size_t c = 0; c < count.size(); ++c)
+			color_begin_[c + 1] = color_begin_[c] + count[c];
+		std::vector<std::size_t> fill(color_begin_.begin(), color_begin_.end() - 1);
+		constraints_.resize(uncolored.size());
+		for(std::size_t k = 0; k < uncolored.size(); ++k)
+			constraints_[fill[colors[k]]++] = uncolored[k];
+	}
+};
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/** @file Profile.hpp
+ * @brief Scoped stage timers, compiled in only with -DCS207_PROFILE.
+ *
+ * @code
+ * void step() {
+ * 	PROFILE_SCOPE("integrate");
+ * 	// code to time
+ * }
+ * @endcode
+ *
+ * Each thread records into its own log: a log2 histogram of durations per
+ * stage and a bounded list of trace events, so timing a scope costs two
+ * clock reads and no locking. At exit a per-stage summary is printed to
+ * std::cerr and the events are written as Chrome trace-event JSON (open in
+ * chrome://tracing or Perfetto) to $CS207_PROFILE_TRACE, by default
+ * profile_trace.json. Scopes nest, so a stage's time includes the stages
+ * timed inside it.
+ *
+ * With CS207_PROFILE_PERF=1 in the environment, each scope also reads the
+ * thread's hardware counters (PerfCounters.hpp) and the summary adds IPC,
+ * LLC misses and branch misses per call. Reading them costs a few system
+ * calls per scope, so leave it off for fine-grained scopes.
+ *
+ * Without CS207_PROFILE, PROFILE_SCOPE expands to nothing.
+ */
+
+#ifdef CS207_PROFILE
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include "CS207/Util.hpp"
+#include "PerfCounters.hpp"
+
+class Profiler {
+	public:
+
+	// Number of log2 duration buckets: bucket b holds [2^b, 2^(b+1)) ns
+	static const int num_buckets = 48;
+	// Trace events kept per thread; later events only enter the histograms
+	static const std::size_t max_events = 1 << 20;
+
+	struct StageStats {
+		uint64_t count;
+		uint64_t total_ns;
+		uint64_t max_ns;
+		uint64_t hist[num_buckets];
+		PerfSample counts;
+	};
+
+	struct Event {
+		int stage;
+		uint64_t start_ns;
+		uint64_t duration_ns;
+	};
+
+	// Everything one thread has recorded. Written only by that thread.
+	struct ThreadLog {
+		unsigned id;
+		std::vector<StageStats> stages;
+		std::vector<Event> events;
+		uint64_t dropped_events;
+		std::unique_ptr<PerfCounters> perf;  // NULL unless counting
+	};
+
+	static Profiler& instance() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// Returns the id of the stage called @a name, registering it if new
+	int stage(const char* name) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for(std::size_t i = 0; i < names_.size(); ++i)
+			if( names_[i] == name )
+				return i;
+		names_.push_back(name);
+		return names_.size() - 1;
+	}
+
+	// Nanoseconds since the profiler started
+	uint64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				epoch_.elapsed()).count();
+	}
+
+	// Returns the counts of the calling thread's counters, all invalid if
+	// counting is off
+	PerfSample counters() {
+		ThreadLog& log = thread_log_();
+		return log.perf ? log.perf->read() : PerfSample();
+	}
+
+	/** Records one timed scope of stage @a s on the calling thread.
+	 * @param[in] counts Counter increments over the scope
+	 */
+	void record(int s, uint64_t start_ns, uint64_t end_ns,
+				const PerfSample& counts) {
+		ThreadLog& log = thread_log_();
+		if( s >= (int) log.stages.size() ) {
+			StageStats empty = StageStats();
+			for(int k = 0; k < PerfSample::num_events; ++k)
+				empty.counts.valid[k] = true;
+			log.stages.resize(s + 1, empty);
+		}
+		uint64_t d = end_ns - start_ns;
+		StageStats& st = log.stages[s];
+		++st.count;
+		st.total_ns += d;
+		st.max_ns = std::max(st.max_ns, d);
+		++st.hist[std::min(bucket_(d), num_buckets - 1)];
+		st.counts += counts;
+		if( log.events.size() < max_events ) {
+			Event e = {s, start_ns, d};
+			log.events.push_back(e);
+		} else {
+			++log.dropped_events;
+		}
+	}
+
+	/** Prints one line per stage and thread: calls, total and mean time,
+	 * and the median and 99th percentile estimated from the histogram.
+	 */
+	void print_summary(std::ostream& s) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		s << "profile: stage thread calls total_s mean_us p50_us p99_us max_us";
+		if( perf_ )
+			s << " ipc llc_misses_per_call branch_misses_per_call";
+		s << std::endl;
+		for(std::size_t k = 0; k < names_.size(); ++k) {
+			for(std::size_t t = 0; t < logs_.size(); ++t) {
+				const ThreadLog& log = *logs_[t];
+				if( k >= log.stages.size() || log.stages[k].count == 0 )
+					continue;
+				const StageStats& st = log.stages[k];
+				s << "profile: " << names_[k] << " " << log.id << " "
+				  << st.count << " " << st.total_ns * 1e-9 << " "
+				  << st.total_ns * 1e-3 / st.count << " "
+				  << percentile_(st, 0.5) * 1e-3 << " "
+				  << percentile_(st, 0.99) * 1e-3 << " "
+				  << st.max_ns * 1e-3;
+				if( perf_ ) {
+					const PerfSample& c = st.counts;
+					if( c.valid[PerfSample::cycles] && c.valid[PerfSample::instructions] )
+						s << " " << c.ipc();
+					else
+						s << " NA";
+					for(int k = PerfSample::llc_misses; k <= PerfSample::branch_misses; ++k) {
+						if( c.valid[k] )
+							s << " " << double(c.value[k]) / st.count;
+						else
+							s << " NA";
+					}
+				}
+				s << std::endl;
+			}
+		}
+	}
+
+	// Writes the recorded events as Chrome trace-event JSON to @a path
+	void write_trace(const std::string& path) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		FILE* f = std::fopen(path.c_str(), "w");
+		if( f == NULL ) {
+			std::cerr << "profile: cannot open " << path << std::endl;
+			return;
+		}
+		std::fprintf(f, "{\"traceEvents\":[\n");
+		bool first = true;
+		uint64_t dropped = 0;
+		for(std::size_t t = 0; t < logs_.size(); ++t) {
+			const ThreadLog& log = *logs_[t];
+			dropped += log.dropped_events;
+			for(std::size_t i = 0; i < log.events.size(); ++i) {
+				const Event& e = log.events[i];
+				std::fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+							 "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+							 first ? "" : ",\n", names_[e.stage].c_str(),
+							 log.id, e.start_ns * 1e-3, e.duration_ns * 1e-3);
+				first = false;
+			}
+		}
+		std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		std::fclose(f);
+		if( dropped )
+			std::cerr << "profile: " << dropped << " events past the trace "
+					  << "limit are only in the summary" << std::endl;
+	}
+
+	~Profiler() {
+		print_summary(std::cerr);
+		const char* path = std::getenv("CS207_PROFILE_TRACE");
+		write_trace(path ? path : "profile_trace.json");
+	}
+
+	private:
+
+	CS207::Clock epoch_;
+	bool perf_;
+	std::mutex mutex_;
+	std::vector<std::string> names_;
+	// Logs outlive their threads so they can be reported at exit
+	std::vector<std::unique_ptr<ThreadLog> > logs_;
+
+	Profiler() {
+		const char* env = std::getenv("CS207_PROFILE_PERF");
+		perf_ = env && std::string(env) == "1";
+	}
+
+	ThreadLog& thread_log_() {
+		static thread_local ThreadLog* log = NULL;
+		if( log == NULL ) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			logs_.push_back(std::unique_ptr<ThreadLog>(new ThreadLog()));
+			log = logs_.back().get();
+			log->id = logs_.size() - 1;
+			log->dropped_events = 0;
+			if( perf_ )
+				log->perf.reset(new PerfCounters());
+		}
+		return *log;
+	}
+
+	static int bucket_(uint64_t ns) {
+		int b = 0;
+		while( ns >>= 1 )
+			++b;
+		return b;
+	}
+
+	// Quantile @a q of the durations, interpolated linearly inside the
+	// bucket that holds it
+	static double percentile_(const StageStats& st, double q) {
+		uint64_t rank = (uint64_t) (q * (st.count - 1)) + 1;
+		uint64_t seen = 0;
+		for(int b = 0; b < num_buckets; ++b) {
+			if( seen + st.hist[b] >= rank ) {
+				double lo = double(uint64_t(1) << b);
+				double frac = double(rank - seen) / st.hist[b];
+				return std::min<double>(lo + frac * lo, st.max_ns);
+			}
+			seen += st.hist[b];
+		}
+		return st.max_ns;
+	}
+};
+
+// Times the enclosing scope as one call of a stage
+class ProfileScope {
+	public:
+	explicit ProfileScope(int stage)
+			: stage_(stage), counts_(Profiler::instance().counters()),
+			  start_(Profiler::instance().now()) {
+	}
+	~ProfileScope() {
+		Profiler& p = Profiler::instance();
+		uint64_t end = p.now();
+		p.record(stage_, start_, end, p.counters() - counts_);
+	}
+	private:
+	int stage_;
+	PerfSample counts_;
+	uint64_t start_;
+};
+
+#define PROFILE_CAT2_(a, b) a##b
+#define PROFILE_CAT_(a, b) PROFILE_CAT2_(a, b)
+
+/** Times the rest of the enclosing scope as stage @a name, a string literal.
+ * The stage is registered once per call site.
+ */
+#define PROFILE_SCOPE(name) \
+	static const int PROFILE_CAT_(profile_stage_, __LINE__) = \
+		Profiler::instance().stage(name); \
+	ProfileScope PROFILE_CAT_(profile_scope_, __LINE__)( \
+		PROFILE_CAT_(profile_stage_, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
+
+#endif
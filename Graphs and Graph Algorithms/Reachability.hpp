@@ -0,0 +1,380 @@
+#ifndef REACHABILITY_HPP
+#define REACHABILITY_HPP
+
+/** @file Reachability.hpp
+ * @brief Reachability queries on a directed graph and transitive
+ * reduction of a DAG.
+ *
+ * ReachabilityIndex answers "is there a path from a to b?" without a full
+ * traversal. Strongly connected components are collapsed first, so
+ * the index works on the condensation DAG, whose component numbers are
+ * topological. Each component then gets labels that decide most queries
+ * at once:
+ * - Interval labels (GRAIL, Yildirim et al.): a depth-first traversal
+ *   numbers the components in post-order, and low[c] is the smallest
+ *   number that c reaches. Whatever c reaches is numbered inside
+ *   [low[c], post[c]], so a target outside it is not reachable. Several
+ *   traversals with random child orders cut more queries. The
+ *   traversals are independent and run in parallel.
+ * - The spanning tree of the first traversal answers positively: b is
+ *   below a in that tree iff b's number is inside a's subtree range.
+ * - A 64-bit signature holds one hashed bit per reachable component, so a
+ *   target whose bit is missing is not reachable.
+ * - Up to 64 landmarks, well-connected components spread over the
+ *   topological order, give two more bitsets per component: the landmarks
+ *   it reaches and the landmarks that reach it. If a reaches a landmark
+ *   that reaches b, a reaches b.
+ * Bitsets are ORed along the DAG one topological level at a time, each
+ * level in parallel. A query that no label decides falls back to a
+ * depth-first search that skips every component the labels rule out.
+ *
+ * transitive_reduction() drops every edge u -> v of a DAG that is implied
+ * by another path, asking the index whether another successor of u
+ * reaches v.
+ *
+ * @code
+ * Adjacency out = out_adjacency(g);
+ * ReachabilityIndex index(out);
+ * bool depends = index.reaches(b, a);
+ * Adjacency minimal = transitive_reduction(out);  // out must be acyclic
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <cstdint>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+#include "TopologicalSort.hpp"
+#include "StronglyConnected.hpp"
+
+/** Index answering reachability queries on a fixed directed graph.
+ * RI: For components c and d, c reaches d implies c <= d and, for every
+ * 	traversal t, low_[t][c] <= post_[t][d] <= post_[t][c]
+ */
+class ReachabilityIndex {
+	public:
+
+	/** Builds the index.
+	 * @param[in] out        The out_adjacency() of a directed graph
+	 * @param[in] traversals Number of interval labels per component
+	 */
+	explicit ReachabilityIndex(const Adjacency& out, int traversals = 3)
+			: scc_(strong_components(out)), dag_(condensation(out, scc_)),
+			  post_(traversals), low_(traversals), scratch_(num_threads()) {
+		std::size_t count = scc_.size();
+		tree_low_.resize(count);
+		parallel_for(0, traversals, [&](std::size_t t) {
+			traverse_(t);
+		}, 1);
+
+		// Landmarks: the best connected component of each of 64 equal
+		// slices of the topological order
+		Adjacency into = reverse_(dag_);
+		std::vector<uint64_t> landmark(count, 0);
+		std::size_t slices = std::min<std::size_t>(64, count);
+		for(std::size_t i = 0; i < slices; ++i) {
+			int best = -1;
+			int64_t best_degree = -1;
+			for(std::size_t c = i * count / slices; c < (i + 1) * count / slices; ++c) {
+				int64_t degree = int64_t(dag_.degree(c) + 1) * (into.degree(c) + 1);
+				if( degree > best_degree ) {
+					best_degree = degree;
+					best = c;
+				}
+			}
+			landmark[best] = uint64_t(1) << i;
+		}
+
+		// Signatures and landmarks reached, from the sinks up one level at
+		// a time; then landmarks reaching, from the sources down
+		signature_.assign(count, 0);
+		to_landmarks_.assign(count, 0);
+		from_landmarks_.assign(count, 0);
+		TopologicalOrder levels = topological_sort(dag_);
+		for(int l = int(levels.num_levels()) - 1; l >= 0; --l) {
+			parallel_for(levels.begin(l), levels.end(l), [&](std::size_t k) {
+				int c = levels.order[k];
+				uint64_t s = bit_(c);
+				uint64_t to = landmark[c];
+				for(int j = dag_.begin(c); j < dag_.end(c); ++j) {
+					s |= signature_[dag_.targets[j]];
+					to |= to_landmarks_[dag_.targets[j]];
+				}
+				signature_[c] = s;
+				to_landmarks_[c] = to;
+			}, 1024);
+		}
+		for(std::size_t l = 0; l < levels.num_levels(); ++l) {
+			parallel_for(levels.begin(l), levels.end(l), [&](std::size_t k) {
+				int c = levels.order[k];
+				uint64_t from = landmark[c];
+				for(int j = into.begin(c); j < into.end(c); ++j)
+					from |= from_landmarks_[into.targets[j]];
+				from_landmarks_[c] = from;
+			}, 1024);
+		}
+	}
+
+	// Number of strongly connected components
+	std::size_t num_components() const {
+		return scc_.size();
+	}
+
+	const StrongComponents& components() const {
+		return scc_;
+	}
+
+	// True if there is a path from node @a a to node @a b; a reaches a
+	bool reaches(int a, int b) {
+		return reaches(a, b, 0);
+	}
+
+	/** reaches() for parallel callers.
+	 * @param[in] w Thread id, 0 <= w < num_threads(); calls with different
+	 * 	@a w may run concurrently
+	 */
+	bool reaches(int a, int b, unsigned w) {
+		int ca = scc_.component[a];
+		int cb = scc_.component[b];
+		if( ca == cb )
+			return true;
+		if( !may_reach_(ca, cb) )
+			return false;
+		if( surely_reaches_(ca, cb) )
+			return true;
+		return search_(ca, cb, scratch_[w]);
+	}
+
+	// Number of queries that needed a search since construction
+	std::size_t searches() const {
+		std::size_t total = 0;
+		for(std::size_t w = 0; w < scratch_.size(); ++w)
+			total += scratch_[w].searches;
+		return total;
+	}
+
+	private:
+
+	/** Marks of the components visited by one thread's searches. A mark
+	 * equal to the current stamp means visited; bumping the stamp clears
+	 * every mark at once.
+	 */
+	struct Scratch {
+		std::vector<unsigned> mark;
+		std::vector<int> stack;
+		unsigned stamp = 0;
+		std::size_t searches = 0;
+	};
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	StrongComponents scc_;
+	// Condensation DAG, components numbered topologically
+	Adjacency dag_;
+	// post_[t][c] and low_[t][c] are the labels of traversal t
+	std::vector<std::vector<int> > post_;
+	std::vector<std::vector<int> > low_;
+	// Smallest post_[0] in the spanning subtree of each component
+	std::vector<int> tree_low_;
+	std::vector<uint64_t> signature_;
+	// Bit i is set if the component reaches, or is reached by, landmark i
+	std::vector<uint64_t> to_landmarks_;
+	std::vector<uint64_t> from_landmarks_;
+	std::vector<Scratch> scratch_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	static uint64_t bit_(int c) {
+		uint32_t h = uint32_t(c) * 2654435761u;
+		return uint64_t(1) << (h >> 26);
+	}
+
+	// False if no label allows a path from component @a c to @a d
+	bool may_reach_(int c, int d) const {
+		if( c > d )
+			return false;
+		if( (signature_[c] & bit_(d)) == 0 )
+			return false;
+		for(std::size_t t = 0; t < post_.size(); ++t)
+			if( post_[t][d] < low_[t][c] || post_[t][d] > post_[t][c] )
+				return false;
+		return true;
+	}
+
+	/** True if a label proves a path from component @a c to @a d: @a d is
+	 * below @a c in the first traversal's spanning tree, or a landmark is
+	 * between them.
+	 */
+	bool surely_reaches_(int c, int d) const {
+		if( to_landmarks_[c] & from_landmarks_[d] )
+			return true;
+		return !post_.empty() && tree_low_[c] <= post_[0][d] &&
+			   post_[0][d] <= post_[0][c];
+	}
+
+	// Returns @a adj with every edge reversed
+	static Adjacency reverse_(const Adjacency& adj) {
+		std::size_t n = adj.num_nodes();
+		Adjacency rev;
+		rev.offsets.assign(n + 1, 0);
+		for(std::size_t k = 0; k < adj.size(); ++k)
+			++rev.offsets[adj.targets[k] + 1];
+		for(std::size_t i = 0; i < n; ++i)
+			rev.offsets[i + 1] += rev.offsets[i];
+		rev.targets.resize(adj.size());
+		rev.edges.resize(adj.size());
+		std::vector<int> fill(rev.offsets.begin(), rev.offsets.end() - 1);
+		for(std::size_t u = 0; u < n; ++u) {
+			for(int k = adj.begin(u); k < adj.end(u); ++k) {
+				int f = fill[adj.targets[k]]++;
+				rev.targets[f] = u;
+				rev.edges[f] = adj.edges[k];
+			}
+		}
+		return rev;
+	}
+
+	/** Depth-first traversal number @a t of the DAG. The first visits the
+	 * children in order; later ones shuffle the roots and the children.
+	 */
+	void traverse_(std::size_t t) {
+		std::size_t count = dag_.num_nodes();
+		std::vector<int>& post = post_[t];
+		std::vector<int>& low = low_[t];
+		post.assign(count, -1);
+		low.assign(count, -1);
+		std::mt19937 rng(t);
+		std::vector<int> roots(count);
+		for(std::size_t c = 0; c < count; ++c)
+			roots[c] = c;
+		if( t > 0 )
+			std::shuffle(roots.begin(), roots.end(), rng);
+
+		// (component, children left) frames; children in a per-frame copy
+		std::vector<std::pair<int, int> > calls;
+		std::vector<int> children;
+		std::vector<char> visited(count, 0);
+		int next = 0;
+		for(std::size_t r = 0; r < count; ++r) {
+			int root = roots[r];
+			if( visited[root] )
+				continue;
+			visited[root] = 1;
+			push_frame_(root, t, rng, calls, children, next);
+			while( !calls.empty() ) {
+				int c = calls.back().first;
+				int& left = calls.back().second;
+				if( left > 0 ) {
+					int d = children.back();
+					children.pop_back();
+					--left;
+					if( !visited[d] ) {
+						visited[d] = 1;
+						push_frame_(d, t, rng, calls, children, next);
+					}
+					continue;
+				}
+				calls.pop_back();
+				post[c] = next++;
+				int l = post[c];
+				for(int j = dag_.begin(c); j < dag_.end(c); ++j)
+					l = std::min(l, low[dag_.targets[j]]);
+				low[c] = l;
+			}
+		}
+	}
+
+	void push_frame_(int c, std::size_t t, std::mt19937& rng,
+					 std::vector<std::pair<int, int> >& calls,
+					 std::vector<int>& children, int next) {
+		std::size_t first = children.size();
+		for(int j = dag_.end(c); j-- > dag_.begin(c); )
+			children.push_back(dag_.targets[j]);
+		if( t > 0 )
+			std::shuffle(children.begin() + first, children.end(), rng);
+		else
+			tree_low_[c] = next;
+		calls.push_back(std::make_pair(c, int(children.size() - first)));
+	}
+
+	// Depth-first search from @a c to @a d through components the labels
+	// allow
+	bool search_(int c, int d, Scratch& s) {
+		++s.searches;
+		if( s.mark.size() != dag_.num_nodes() )
+			s.mark.assign(dag_.num_nodes(), 0);
+		if( ++s.stamp == 0 ) {
+			std::fill(s.mark.begin(), s.mark.end(), 0);
+			s.stamp = 1;
+		}
+		s.stack.assign(1, c);
+		s.mark[c] = s.stamp;
+		while( !s.stack.empty() ) {
+			int u = s.stack.back();
+			s.stack.pop_back();
+			for(int j = dag_.begin(u); j < dag_.end(u); ++j) {
+				int v = dag_.targets[j];
+				if( v == d || surely_reaches_(v, d) )
+					return true;
+				if( s.mark[v] != s.stamp && may_reach_(v, d) ) {
+					s.mark[v] = s.stamp;
+					s.stack.push_back(v);
+				}
+			}
+		}
+		return false;
+	}
+};
+
+/** Returns the transitive reduction of a DAG: the edges u -> v for which
+ * no other path leads from u to v. Duplicate edges are kept once.
+ * edges[k] keeps the Graph edge index of each kept edge.
+ * @param[in] out The out_adjacency() of a directed acyclic graph
+ */
+inline Adjacency transitive_reduction(const Adjacency& out) {
+	ReachabilityIndex index(out);
+	const std::vector<int>& rank = index.components().component;
+	std::size_t n = out.num_nodes();
+	std::vector<char> keep(out.size(), 0);
+	parallel_for_chunks(0, n, [&](std::size_t b, std::size_t e, unsigned w) {
+		std::vector<std::pair<int, int> > succ;  // (rank, entry)
+		for(std::size_t u = b; u < e; ++u) {
+			succ.clear();
+			for(int k = out.begin(u); k < out.end(u); ++k)
+				succ.push_back(std::make_pair(rank[out.targets[k]], k));
+			// A successor can only be reached through one ranked before it
+			std::sort(succ.begin(), succ.end());
+			for(std::size_t i = 0; i < succ.size(); ++i) {
+				if( i > 0 && succ[i].first == succ[i - 1].first )
+					continue;
+				int v = out.targets[succ[i].second];
+				bool implied = false;
+				for(std::size_t j = 0; j < i && !implied; ++j)
+					implied = index.reaches(out.targets[succ[j].second], v, w);
+				keep[succ[i].second] = !implied;
+			}
+		}
+	}, 256);
+
+	Adjacency reduced;
+	reduced.offsets.reserve(n + 1);
+	for(std::size_t u = 0; u < n; ++u) {
+		for(int k = out.begin(u); k < out.end(u); ++k) {
+			if( keep[k] ) {
+				reduced.targets.push_back(out.targets[k]);
+				reduced.edges.push_back(out.edges[k]);
+			}
+		}
+		reduced.offsets.push_back(reduced.targets.size());
+	}
+	return reduced;
+}
+
+#endif
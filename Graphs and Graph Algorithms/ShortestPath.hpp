@@ -0,0 +1,436 @@
+#ifndef SHORTEST_PATH_HPP
+#define SHORTEST_PATH_HPP
+
+/** @file ShortestPath.hpp
+ * @brief Single-source shortest paths on an Adjacency snapshot.
+ *
+ * Distances and predecessors live in dense arrays indexed by node index,
+ * so the Graph's node data is never touched. Edge weights are given per
+ * adjacency entry: weight[k] is the length of the step from node i to
+ * adj.targets[k].
+ *
+ * @code
+ * Adjacency adj = out_adjacency(g);
+ * std::vector<double> w = euclidean_weights(g, adj);
+ * ShortestPathTree<double> tree = dijkstra(adj, w, source);
+ * @endcode
+ */
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+
+/** Result of a single-source search.
+ * RI: dist[i] == unreachable() iff node i was not reached
+ * RI: pred[i] is the node before i on a shortest path, -1 for the sources
+ * 	and for unreached nodes
+ */
+template <typename D>
+struct ShortestPathTree {
+	typedef D distance_type;
+
+	std::vector<D> dist;
+	std::vector<int> pred;
+
+	static D unreachable() {
+		return std::numeric_limits<D>::has_infinity
+			   ? std::numeric_limits<D>::infinity()
+			   : std::numeric_limits<D>::max();
+	}
+
+	bool reached(int i) const {
+		return dist[i] != unreachable();
+	}
+
+	// Returns the nodes of a shortest path ending at @a target, source
+	// first, or an empty path if @a target was not reached
+	std::vector<int> path_to(int target) const {
+		std::vector<int> path;
+		if( !reached(target) )
+			return path;
+		for(int i = target; i >= 0; i = pred[i])
+			path.push_back(i);
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+
+	// Resets the tree to @a n unreached nodes
+	void reset(std::size_t n) {
+		dist.assign(n, unreachable());
+		pred.assign(n, -1);
+	}
+};
+
+/** Min-priority queue over the ids 0 ... n-1, stored as a 4-ary heap.
+ * Each id is in the heap at most once; pos_ maps an id to its slot so a
+ * key can be lowered in place. Keys are stored next to the ids so sifting
+ * reads one contiguous array.
+ *
+ * RI: heap_[pos_[id]].id == id for every id in the heap, pos_[id] == -1
+ * 	otherwise
+ * RI: heap_[(i - 1) / 4].key <= heap_[i].key for i > 0
+ */
+template <typename K>
+class IndexedHeap {
+	struct Entry {
+		K key;
+		int id;
+	};
+
+	public:
+
+	// Empties the heap and makes room for the ids 0 ... n-1
+	void reset(std::size_t n) {
+		heap_.clear();
+		pos_.assign(n, -1);
+	}
+
+	// Makes room for the ids 0 ... n-1, keeping the ids in the heap
+	void grow(std::size_t n) {
+		if( n > pos_.size() )
+			pos_.resize(n, -1);
+	}
+
+	// Empties the heap in time proportional to its size
+	void clear() {
+		for(std::size_t k = 0; k < heap_.size(); ++k)
+			pos_[heap_[k].id] = -1;
+		heap_.clear();
+	}
+
+	bool empty() const {
+		return heap_.empty();
+	}
+
+	std::size_t size() const {
+		return heap_.size();
+	}
+
+	bool contains(int id) const {
+		return pos_[id] >= 0;
+	}
+
+	const K& top_key() const {
+		return heap_[0].key;
+	}
+
+	int top() const {
+		return heap_[0].id;
+	}
+
+	/** Inserts @a id with @a key, or lowers its key if it is in the heap.
+	 * @pre If @a id is in the heap, @a key is not larger than its key.
+	 */
+	void push(int id, const K& key) {
+		int i = pos_[id];
+		if( i < 0 ) {
+			i = heap_.size();
+			Entry e = {key, id};
+			heap_.push_back(e);
+		} else {
+			heap_[i].key = key;
+		}
+		sift_up_(i);
+	}
+
+	// Removes and returns the id with the smallest key
+	int pop() {
+		int id = heap_[0].id;
+		pos_[id] = -1;
+		Entry last = heap_.back();
+		heap_.pop_back();
+		if( !heap_.empty() ) {
+			heap_[0] = last;
+			sift_down_(0);
+		}
+		return id;
+	}
+
+	private:
+	std::vector<Entry> heap_;
+	std::vector<int> pos_;
+
+	void sift_up_(int i) {
+		Entry e = heap_[i];
+		while( i > 0 ) {
+			int parent = (i - 1) / 4;
+			if( !(e.key < heap_[parent].key) )
+				break;
+			heap_[i] = heap_[parent];
+			pos_[heap_[i].id] = i;
+			i = parent;
+		}
+		heap_[i] = e;
+		pos_[e.id] = i;
+	}
+
+	void sift_down_(int i) {
+		Entry e = heap_[i];
+		int n = heap_.size();
+		while( 1 ) {
+			int first = 4 * i + 1;
+			if( first >= n )
+				break;
+			int best = first;
+			int last = std::min(first + 4, n);
+			for(int c = first + 1; c < last; ++c)
+				if( heap_[c].key < heap_[best].key )
+					best = c;
+			if( !(heap_[best].key < e.key) )
+				break;
+			heap_[i] = heap_[best];
+			pos_[heap_[i].id] = i;
+			i = best;
+		}
+		heap_[i] = e;
+		pos_[e.id] = i;
+	}
+};
+
+/** Labels of a search that visits few nodes of a large graph.
+ * Arrays are sized once; clear() resets only the touched entries, so a
+ * search costs time in the nodes it labels, not in the graph size.
+ *
+ * RI: dist[i] != unreachable or pred[i] != -1 only for i in touched
+ */
+template <typename D>
+struct SearchScratch {
+	std::vector<D> dist;
+	std::vector<int> pred;
+	std::vector<int> touched;
+	IndexedHeap<D> heap;
+
+	// Makes room for @a n nodes. @pre The scratch is clear.
+	void prepare(std::size_t n) {
+		if( dist.size() != n ) {
+			dist.assign(n, ShortestPathTree<D>::unreachable());
+			pred.assign(n, -1);
+			heap.reset(n);
+		}
+	}
+
+	// Sets the distance and predecessor of @a v
+	void label(int v, D d, int u) {
+		if( dist[v] == ShortestPathTree<D>::unreachable() )
+			touched.push_back(v);
+		dist[v] = d;
+		pred[v] = u;
+	}
+
+	void clear() {
+		for(std::size_t k = 0; k < touched.size(); ++k) {
+			dist[touched[k]] = ShortestPathTree<D>::unreachable();
+			pred[touched[k]] = -1;
+		}
+		touched.clear();
+		heap.clear();
+	}
+};
+
+/** Monotone priority queue for integer keys.
+ * Keys popped never decrease, so an entry only needs to live in bucket b,
+ * the position of the highest bit in which its key differs from the last
+ * popped key. Each entry moves down at most 64 times. Entries are not
+ * updated in place: callers push a node again when its key drops and skip
+ * stale entries when they are popped.
+ */
+class RadixHeap {
+	struct Entry {
+		uint64_t key;
+		int id;
+	};
+
+	public:
+
+	RadixHeap() : last_(0), size_(0) {
+	}
+
+	void clear() {
+		for(int b = 0; b < num_buckets; ++b)
+			buckets_[b].clear();
+		last_ = 0;
+		size_ = 0;
+	}
+
+	bool empty() const {
+		return size_ == 0;
+	}
+
+	// Inserts @a id with @a key. @pre key >= the last popped key
+	void push(int id, uint64_t key) {
+		Entry e = {key, id};
+		buckets_[bucket_(key)].push_back(e);
+		++size_;
+	}
+
+	// Removes an entry with the smallest key; returns its id and key
+	int pop(uint64_t& key) {
+		if( buckets_[0].empty() ) {
+			int b = 1;
+			while( buckets_[b].empty() )
+				++b;
+			// Every entry of bucket b lands in a lower bucket once last_ is
+			// the smallest key of b
+			std::vector<Entry>& from = buckets_[b];
+			uint64_t least = from[0].key;
+			for(std::size_t k = 1; k < from.size(); ++k)
+				least = std::min(least, from[k].key);
+			last_ = least;
+			for(std::size_t k = 0; k < from.size(); ++k)
+				buckets_[bucket_(from[k].key)].push_back(from[k]);
+			from.clear();
+		}
+		Entry e = buckets_[0].back();
+		buckets_[0].pop_back();
+		--size_;
+		key = e.key;
+		return e.id;
+	}
+
+	private:
+	static const int num_buckets = 65;
+	std::vector<Entry> buckets_[num_buckets];
+	uint64_t last_;
+	std::size_t size_;
+
+	int bucket_(uint64_t key) const {
+		uint64_t diff = key ^ last_;
+		int b = 0;
+		while( diff ) {
+			++b;
+			diff >>= 1;
+		}
+		return b;
+	}
+};
+
+/** Returns the Euclidean length of the edge behind each adjacency entry. */
+template <typename G>
+std::vector<double> euclidean_weights(G& g, const Adjacency& adj) {
+	std::vector<double> w(adj.size());
+	for(std::size_t i = 0; i < adj.num_nodes(); ++i) {
+		auto p = g.node(i).position();
+		for(int k = adj.begin(i); k < adj.end(i); ++k)
+			w[k] = norm(p - g.node(adj.targets[k]).position());
+	}
+	return w;
+}
+
+/** Dijkstra's algorithm with an IndexedHeap from several sources at once.
+ * @param[in] weight  Non-negative length of each adjacency entry
+ * @param[in] sources Node indices that start at distance 0
+ * @param[in,out] heap Scratch heap, reused between calls to save allocation
+ * @post tree.dist[i] is the distance from i to the nearest source
+ */
+template <typename D>
+void dijkstra(const Adjacency& adj, const std::vector<D>& weight,
+			  const std::vector<int>& sources, ShortestPathTree<D>& tree,
+			  IndexedHeap<D>& heap) {
+	tree.reset(adj.num_nodes());
+	heap.reset(adj.num_nodes());
+	for(std::size_t k = 0; k < sources.size(); ++k) {
+		tree.dist[sources[k]] = 0;
+		heap.push(sources[k], 0);
+	}
+	while( !heap.empty() ) {
+		int u = heap.pop();
+		D du = tree.dist[u];
+		for(int k = adj.begin(u); k < adj.end(u); ++k) {
+			int v = adj.targets[k];
+			D dv = du + weight[k];
+			if( dv < tree.dist[v] ) {
+				tree.dist[v] = dv;
+				tree.pred[v] = u;
+				heap.push(v, dv);
+			}
+		}
+	}
+}
+
+/** Dijkstra's algorithm from @a source. */
+template <typename D>
+void dijkstra(const Adjacency& adj, const std::vector<D>& weight, int source,
+			  ShortestPathTree<D>& tree, IndexedHeap<D>& heap) {
+	dijkstra(adj, weight, std::vector<int>(1, source), tree, heap);
+}
+
+template <typename D>
+ShortestPathTree<D> dijkstra(const Adjacency& adj, const std::vector<D>& weight,
+							 int source) {
+	ShortestPathTree<D> tree;
+	IndexedHeap<D> heap;
+	dijkstra(adj, weight, source, tree, heap);
+	return tree;
+}
+
+/** Returns, for each node of @a tree, the position in @a sources of the
+ * source its shortest path starts from, or -1 if it was not reached.
+ * Follows the predecessors by pointer jumping, so the work is parallel
+ * and takes log(depth) rounds.
+ * @pre @a tree was computed from @a sources
+ */
+template <typename D>
+std::vector<int> path_sources(const ShortestPathTree<D>& tree,
+							  const std::vector<int>& sources) {
+	std::size_t n = tree.pred.size();
+	// root[i] is a node on the path to i, and after the last round its start
+	std::vector<int> root(n), next(n);
+	parallel_for(0, n, [&](std::size_t i) {
+		root[i] = tree.pred[i] < 0 ? i : tree.pred[i];
+	}, 4096);
+	std::atomic<bool> changed(true);
+	while( changed ) {
+		changed = false;
+		parallel_for(0, n, [&](std::size_t i) {
+			next[i] = root[root[i]];
+			if( next[i] != root[i] )
+				changed.store(true, std::memory_order_relaxed);
+		}, 4096);
+		root.swap(next);
+	}
+
+	std::vector<int> index(n, -1);
+	for(std::size_t k = sources.size(); k-- > 0; )
+		index[sources[k]] = k;
+	std::vector<int> owner(n);
+	parallel_for(0, n, [&](std::size_t i) {
+		owner[i] = tree.reached(i) ? index[root[i]] : -1;
+	}, 4096);
+	return owner;
+}
+
+/** Dijkstra's algorithm with a RadixHeap, for integer weights.
+ * Usually faster than the IndexedHeap version since pushes are appends
+ * and there is no sifting.
+ */
+inline ShortestPathTree<uint64_t> dijkstra_radix(const Adjacency& adj,
+												 const std::vector<uint32_t>& weight,
+												 int source) {
+	ShortestPathTree<uint64_t> tree;
+	tree.reset(adj.num_nodes());
+	RadixHeap heap;
+	tree.dist[source] = 0;
+	heap.push(source, 0);
+	while( !heap.empty() ) {
+		uint64_t du;
+		int u = heap.pop(du);
+		if( du != tree.dist[u] )
+			continue;  // Stale entry, u was reached more cheaply
+		for(int k = adj.begin(u); k < adj.end(u); ++k) {
+			int v = adj.targets[k];
+			uint64_t dv = du + weight[k];
+			if( dv < tree.dist[v] ) {
+				tree.dist[v] = dv;
+				tree.pred[v] = u;
+				heap.push(v, dv);
+			}
+		}
+	}
+	return tree;
+}
+
+#endif
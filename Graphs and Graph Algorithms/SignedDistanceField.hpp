@@ -0,0 +1,402 @@
+#ifndef SIGNED_DISTANCE_FIELD_HPP
+#define SIGNED_DISTANCE_FIELD_HPP
+
+/** @file SignedDistanceField.hpp
+ * @brief Signed distance grid sampled from a triangle mesh.
+ *
+ * The grid is built once from a triangle mesh and then queried with
+ * trilinear interpolation, so the cost of a query does not depend on the
+ * number of triangles in the obstacle.
+ */
+
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <map>
+#include <cmath>
+#include "Point.hpp"
+
+/** Signed distance field stored on a regular 3D grid.
+ * RI: phi_.size() == nx_ * ny_ * nz_
+ * RI: Cell (i, j, k) is centered at origin_ + h_ * Point(i, j, k)
+ * Negative values are inside the obstacle, positive values are outside.
+ */
+class SignedDistanceField {
+
+	typedef std::array<int, 3> triangle;
+
+	public:
+
+	typedef double value_type;
+
+	// Construct an empty field. Every sample reports "far outside".
+	SignedDistanceField() : h_(1), nx_(0), ny_(0), nz_(0) {
+	}
+
+	/** Voxelizes a triangle mesh into a signed distance grid.
+	 * @param[in] verts     Mesh vertex positions
+	 * @param[in] tris      Triangles as triples of indices into @a verts
+	 * @param[in] h         Grid spacing
+	 * @param[in] padding   Extra distance added around the mesh bounding box
+	 * @param[in] thickness Half-thickness given to open (non-closed) meshes
+	 * @pre 0 <= tris[i][j] < verts.size() for all i, j
+	 * @pre h > 0
+	 *
+	 * If every mesh edge is shared by exactly two triangles the mesh is
+	 * treated as closed and the sign comes from ray parity along x.
+	 * Otherwise the mesh is treated as a shell and the field is the
+	 * unsigned distance minus @a thickness.
+	 */
+	SignedDistanceField(const std::vector<Point>& verts,
+						const std::vector<triangle>& tris,
+						value_type h, value_type padding,
+						value_type thickness = 0)
+				: h_(h), nx_(0), ny_(0), nz_(0) {
+		if( verts.empty() || tris.empty() )
+			return;
+		// Size the grid from the bounding box of the mesh
+		Point lo = verts[0];
+		Point hi = verts[0];
+		for(auto it = verts.begin(); it != verts.end(); ++it) {
+			for(int d = 0; d < 3; ++d) {
+				lo[d] = std::min(lo[d], (*it)[d]);
+				hi[d] = std::max(hi[d], (*it)[d]);
+			}
+		}
+		lo -= padding + thickness;
+		hi += padding + thickness;
+		origin_ = lo;
+		nx_ = (int) std::ceil((hi.x - lo.x) / h_) + 1;
+		ny_ = (int) std::ceil((hi.y - lo.y) / h_) + 1;
+		nz_ = (int) std::ceil((hi.z - lo.z) / h_) + 1;
+
+		std::vector<int> closest;
+		unsigned_distance_(verts, tris, closest);
+		if( is_closed_(tris) )
+			apply_parity_sign_(verts, tris);
+		else {
+			for(auto it = phi_.begin(); it != phi_.end(); ++it)
+				*it -= thickness;
+		}
+	}
+
+	/** Samples the field at the positions in @a x, @a y, @a z.
+	 * @param[in]  n        Number of samples
+	 * @param[in]  x, y, z  Sample coordinates, one array per component
+	 * @param[out] phi      Interpolated signed distance
+	 * @param[out] gx, gy, gz Gradient of the interpolant
+	 *
+	 * Samples outside the grid report +infinity and a zero gradient.
+	 * The loop body has no early exit: every sample is interpolated and
+	 * the outside ones are masked afterwards. The loop still does not
+	 * auto-vectorize, because the eight corner loads are gathers and the
+	 * integer conversions may trap under the default -ftrapping-math.
+	 */
+	void sample(std::size_t n,
+				const value_type* x, const value_type* y, const value_type* z,
+				value_type* phi,
+				value_type* gx, value_type* gy, value_type* gz) const {
+		if( nx_ < 2 || ny_ < 2 || nz_ < 2 ) {
+			std::fill(phi, phi + n, std::numeric_limits<value_type>::infinity());
+			std::fill(gx, gx + n, 0);
+			std::fill(gy, gy + n, 0);
+			std::fill(gz, gz + n, 0);
+			return;
+		}
+		for(std::size_t i = 0; i < n; ++i) {
+			sample_(x[i], y[i], z[i], phi[i], gx[i], gy[i], gz[i]);
+		}
+	}
+
+	// Returns the signed distance at the point @a p.
+	value_type distance(const Point& p) const {
+		value_type phi, gx, gy, gz;
+		sample(1, &p.x, &p.y, &p.z, &phi, &gx, &gy, &gz);
+		return phi;
+	}
+
+	// Returns the gradient of the signed distance at the point @a p.
+	Point gradient(const Point& p) const {
+		value_type phi, gx, gy, gz;
+		sample(1, &p.x, &p.y, &p.z, &phi, &gx, &gy, &gz);
+		return Point(gx, gy, gz);
+	}
+
+	// Returns the grid spacing
+	value_type spacing() const {
+		return h_;
+	}
+
+	// Returns the number of grid samples
+	std::size_t size() const {
+		return phi_.size();
+	}
+
+	private:
+
+	/////////////////////////////////////////////////////////////////////
+	///// PRIVATE MEMBERS ///////////////////////////////////////////////
+	/////////////////////////////////////////////////////////////////////
+
+	// Position of sample (0, 0, 0) and the spacing between samples
+	Point origin_;
+	value_type h_;
+
+	// Grid dimensions and samples, stored with x varying fastest
+	int nx_, ny_, nz_;
+	std::vector<value_type> phi_;
+
+	//////////////////////////////////////////////////////////////////////
+	///// HELPER FUNCTIONS ///////////////////////////////////////////////
+	//////////////////////////////////////////////////////////////////////
+
+	int index_(int i, int j, int k) const {
+		return i + nx_ * (j + ny_ * k);
+	}
+
+	/** Trilinear interpolation of phi_ and its gradient at (px, py, pz).
+	 * @pre nx_, ny_, nz_ >= 2
+	 *
+	 * No early exit: an outside point, or a NaN, is interpolated in cell
+	 * (0, 0, 0) like any other, and the result is then replaced by
+	 * +infinity and a zero gradient. This keeps a run of samples near the
+	 * grid boundary free of mispredicted exits.
+	 */
+	void sample_(value_type px, value_type py, value_type pz,
+				 value_type& phi,
+				 value_type& gx, value_type& gy, value_type& gz) const {
+		value_type fx = (px - origin_.x) / h_;
+		value_type fy = (py - origin_.y) / h_;
+		value_type fz = (pz - origin_.z) / h_;
+		// Bitwise & so that all six tests are evaluated without branching
+		bool inside = (0 <= fx) & (fx < nx_ - 1) & (0 <= fy) & (fy < ny_ - 1) &
+					  (0 <= fz) & (fz < nz_ - 1);
+		fx = inside ? fx : 0;
+		fy = inside ? fy : 0;
+		fz = inside ? fz : 0;
+		int i = (int) fx, j = (int) fy, k = (int) fz;
+		value_type u = fx - i, v = fy - j, w = fz - k;
+
+		const value_type* c = &phi_[index_(i, j, k)];
+		const int sy = nx_;
+		const int sz = nx_ * ny_;
+		value_type c000 = c[0],       c100 = c[1];
+		value_type c010 = c[sy],      c110 = c[sy + 1];
+		value_type c001 = c[sz],      c101 = c[sz + 1];
+		value_type c011 = c[sz + sy], c111 = c[sz + sy + 1];
+
+		// Interpolate along x, then y, then z
+		value_type c00 = c000 + u * (c100 - c000);
+		value_type c10 = c010 + u * (c110 - c010);
+		value_type c01 = c001 + u * (c101 - c001);
+		value_type c11 = c011 + u * (c111 - c011);
+		value_type c0 = c00 + v * (c10 - c00);
+		value_type c1 = c01 + v * (c11 - c01);
+		value_type value = c0 + w * (c1 - c0);
+
+		// Analytic derivative of the trilinear interpolant
+		value_type dx00 = c100 - c000, dx10 = c110 - c010;
+		value_type dx01 = c101 - c001, dx11 = c111 - c011;
+		value_type dx0 = dx00 + v * (dx10 - dx00);
+		value_type dx1 = dx01 + v * (dx11 - dx01);
+		value_type dy0 = c10 - c00, dy1 = c11 - c01;
+		phi = inside ? value : std::numeric_limits<value_type>::infinity();
+		gx = inside ? (dx0 + w * (dx1 - dx0)) / h_ : 0;
+		gy = inside ? (dy0 + w * (dy1 - dy0)) / h_ : 0;
+		gz = inside ? (c1 - c0) / h_ : 0;
+	}
+
+	// Returns true if every edge of the mesh is shared by two triangles.
+	static bool is_closed_(const std::vector<triangle>& tris) {
+		std::map<std::pair<int, int>, int> edge_count;
+		for(auto it = tris.begin(); it != tris.end(); ++it) {
+			for(int a = 0; a < 3; ++a) {
+				int n1 = (*it)[a];
+				int n2 = (*it)[(a + 1) % 3];
+				++edge_count[std::make_pair(std::min(n1, n2),
+											std::max(n1, n2))];
+			}
+		}
+		for(auto it = edge_count.begin(); it != edge_count.end(); ++it) {
+			if( it->second != 2 )
+				return false;
+		}
+		return true;
+	}
+
+	// Returns the distance from @a p to the triangle (a, b, c).
+	static value_type point_triangle_distance_(const Point& p, const Point& a,
+											   const Point& b, const Point& c) {
+		// Closest point on a triangle, by Voronoi region of the triangle
+		Point ab = b - a, ac = c - a, ap = p - a;
+		value_type d1 = dot(ab, ap), d2 = dot(ac, ap);
+		if( d1 <= 0 && d2 <= 0 )
+			return norm(ap);
+		Point bp = p - b;
+		value_type d3 = dot(ab, bp), d4 = dot(ac, bp);
+		if( d3 >= 0 && d4 <= d3 )
+			return norm(bp);
+		value_type vc = d1 * d4 - d3 * d2;
+		if( vc <= 0 && d1 >= 0 && d3 <= 0 )
+			return norm(ap - (d1 / (d1 - d3)) * ab);
+		Point cp = p - c;
+		value_type d5 = dot(ab, cp), d6 = dot(ac, cp);
+		if( d6 >= 0 && d5 <= d6 )
+			return norm(cp);
+		value_type vb = d5 * d2 - d1 * d6;
+		if( vb <= 0 && d2 >= 0 && d6 <= 0 )
+			return norm(ap - (d2 / (d2 - d6)) * ac);
+		value_type va = d3 * d6 - d5 * d4;
+		if( va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0 )
+			return norm(bp - ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b));
+		value_type denom = 1 / (va + vb + vc);
+		return norm(ap - (vb * denom) * ab - (vc * denom) * ac);
+	}
+
+	/** Fills phi_ with the unsigned distance to the mesh.
+	 * Exact distances are computed in a narrow band around each triangle
+	 * and then propagated to the rest of the grid by fast sweeping, where
+	 * each sample inherits the closest triangle of a neighbor.
+	 */
+	void unsigned_distance_(const std::vector<Point>& verts,
+							const std::vector<triangle>& tris,
+							std::vector<int>& closest) {
+		const value_type far = (nx_ + ny_ + nz_) * h_;
+		const int band = 1;
+		phi_.assign(nx_ * ny_ * nz_, far);
+		closest.assign(phi_.size(), -1);
+
+		for(int t = 0; t < (int) tris.size(); ++t) {
+			const Point& a = verts[tris[t][0]];
+			const Point& b = verts[tris[t][1]];
+			const Point& c = verts[tris[t][2]];
+			int lo[3], hi[3];
+			for(int d = 0; d < 3; ++d) {
+				value_type mn = std::min(a[d], std::min(b[d], c[d]));
+				value_type mx = std::max(a[d], std::max(b[d], c[d]));
+				int dim = (d == 0 ? nx_ : (d == 1 ? ny_ : nz_));
+				lo[d] = std::max(0, (int) ((mn - origin_[d]) / h_) - band);
+				hi[d] = std::min(dim - 1, (int) ((mx - origin_[d]) / h_) + band + 1);
+			}
+			for(int k = lo[2]; k <= hi[2]; ++k)
+				for(int j = lo[1]; j <= hi[1]; ++j)
+					for(int i = lo[0]; i <= hi[0]; ++i) {
+						Point p = origin_ + h_ * Point(i, j, k);
+						value_type d = point_triangle_distance_(p, a, b, c);
+						int idx = index_(i, j, k);
+						if( d < phi_[idx] ) {
+							phi_[idx] = d;
+							closest[idx] = t;
+						}
+					}
+		}
+
+		// Sweep in all eight diagonal directions, twice
+		for(int pass = 0; pass < 2; ++pass) {
+			for(int dir = 0; dir < 8; ++dir) {
+				int di = (dir & 1) ? -1 : 1;
+				int dj = (dir & 2) ? -1 : 1;
+				int dk = (dir & 4) ? -1 : 1;
+				int i0 = di > 0 ? 1 : nx_ - 2, i1 = di > 0 ? nx_ : -1;
+				int j0 = dj > 0 ? 1 : ny_ - 2, j1 = dj > 0 ? ny_ : -1;
+				int k0 = dk > 0 ? 1 : nz_ - 2, k1 = dk > 0 ? nz_ : -1;
+				for(int k = k0; k != k1; k += dk)
+					for(int j = j0; j != j1; j += dj)
+						for(int i = i0; i != i1; i += di) {
+							Point p = origin_ + h_ * Point(i, j, k);
+							int idx = index_(i, j, k);
+							check_neighbor_(verts, tris, closest, p, idx,
+											index_(i - di, j, k));
+							check_neighbor_(verts, tris, closest, p, idx,
+											index_(i, j - dj, k));
+							check_neighbor_(verts, tris, closest, p, idx,
+											index_(i, j, k - dk));
+						}
+			}
+		}
+	}
+
+	// Tries the closest triangle of sample @a nbr as the closest of @a idx.
+	void check_neighbor_(const std::vector<Point>& verts,
+						 const std::vector<triangle>& tris,
+						 std::vector<int>& closest,
+						 const Point& p, int idx, int nbr) {
+		int t = closest[nbr];
+		if( t < 0 || t == closest[idx] )
+			return;
+		value_type d = point_triangle_distance_(p, verts[tris[t][0]],
+												verts[tris[t][1]],
+												verts[tris[t][2]]);
+		if( d < phi_[idx] ) {
+			phi_[idx] = d;
+			closest[idx] = t;
+		}
+	}
+
+	/** Negates phi_ inside a closed mesh.
+	 * Counts crossings of each grid row (fixed j, k) with the triangles
+	 * projected onto the yz-plane; samples after an odd number of
+	 * crossings are inside.
+	 */
+	void apply_parity_sign_(const std::vector<Point>& verts,
+							const std::vector<triangle>& tris) {
+		std::vector<int> crossings(phi_.size(), 0);
+		for(auto it = tris.begin(); it != tris.end(); ++it) {
+			const Point& a = verts[(*it)[0]];
+			const Point& b = verts[(*it)[1]];
+			const Point& c = verts[(*it)[2]];
+			int j0 = std::max(0, (int) std::ceil((std::min(a.y, std::min(b.y, c.y)) - origin_.y) / h_));
+			int j1 = std::min(ny_ - 1, (int) std::floor((std::max(a.y, std::max(b.y, c.y)) - origin_.y) / h_));
+			int k0 = std::max(0, (int) std::ceil((std::min(a.z, std::min(b.z, c.z)) - origin_.z) / h_));
+			int k1 = std::min(nz_ - 1, (int) std::floor((std::max(a.z, std::max(b.z, c.z)) - origin_.z) / h_));
+			for(int k = k0; k <= k1; ++k)
+				for(int j = j0; j <= j1; ++j) {
+					// Nudge the row off the grid lines so that it never
+					// passes exactly through a mesh edge or vertex
+					value_type y = origin_.y + (j + 1.31e-6) * h_;
+					value_type z = origin_.z + (k + 2.72e-6) * h_;
+					value_type x;
+					if( !row_intersection_(y, z, a, b, c, x) )
+						continue;
+					int i = (int) std::ceil((x - origin_.x) / h_);
+					if( i < 0 )
+						i = 0;
+					if( i < nx_ )
+						++crossings[index_(i, j, k)];
+				}
+		}
+		for(int k = 0; k < nz_; ++k)
+			for(int j = 0; j < ny_; ++j) {
+				int total = 0;
+				for(int i = 0; i < nx_; ++i) {
+					int idx = index_(i, j, k);
+					total += crossings[idx];
+					if( total % 2 == 1 )
+						phi_[idx] = -phi_[idx];
+				}
+			}
+	}
+
+	// Returns true if the line {(x, y, z)} crosses the triangle (a, b, c)
+	// 	and sets @a x to the crossing.
+	static bool row_intersection_(value_type y, value_type z,
+								  const Point& a, const Point& b,
+								  const Point& c, value_type& x) {
+		value_type wa = orient_(y, z, b, c);
+		value_type wb = orient_(y, z, c, a);
+		value_type wc = orient_(y, z, a, b);
+		if( !((wa > 0 && wb > 0 && wc > 0) ||
+			  (wa < 0 && wb < 0 && wc < 0)) )
+			return false;
+		x = (wa * a.x + wb * b.x + wc * c.x) / (wa + wb + wc);
+		return true;
+	}
+
+	static value_type orient_(value_type y, value_type z,
+							  const Point& p, const Point& q) {
+		return (p.y - y) * (q.z - z) - (p.z - z) * (q.y - y);
+	}
+};
+
+#endif
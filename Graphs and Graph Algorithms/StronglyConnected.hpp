@@ -0,0 +1,391 @@
+#ifndef STRONGLY_CONNECTED_HPP
+#define STRONGLY_CONNECTED_HPP
+
+/** @file StronglyConnected.hpp
+ * @brief Strongly connected components, condensation and cycles of a
+ * directed graph.
+ *
+ * strong_components() is Pearce's space-efficient variant of Tarjan's
+ * algorithm. It keeps one rank per node instead of Tarjan's index, lowlink
+ * and on-stack flag, and runs on an explicit stack, so deep graphs cannot
+ * overflow the call stack.
+ *
+ * parallel_strong_components() is for very large graphs, whose largest
+ * component usually holds most of the nodes. It first trims, in parallel,
+ * nodes with no incoming or no outgoing edge left; each of those is a
+ * component on its own. It then takes the pivot with the most edges and
+ * finds the nodes it reaches and the nodes that reach it by parallel
+ * breadth-first searches; the nodes in both sets are the pivot's
+ * component. Pearce's algorithm sorts out the few nodes left over.
+ *
+ * Both number the components in topological order: every edge between
+ * two components goes from a lower to a higher number. condensation()
+ * gives the DAG of components, which topological_sort() can order, and
+ * cycles() gives an explicit cycle through each component that has one.
+ *
+ * @code
+ * Adjacency out = out_adjacency(g);
+ * StrongComponents scc = strong_components(out);
+ * std::vector<std::vector<int> > loops = cycles(out, scc);
+ * TopologicalOrder t = topological_sort(condensation(out, scc));
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+#include "BFS.hpp"
+#include "TopologicalSort.hpp"
+
+/** Strongly connected components of a directed graph, by node index.
+ * RI: Nodes i and j are in the same component iff there are paths i -> j
+ * 	and j -> i
+ * RI: For every edge i -> j, component[i] <= component[j]
+ * RI: The nodes of component c are nodes[offsets[c]] ...
+ * 	nodes[offsets[c+1] - 1], in increasing index order
+ */
+struct StrongComponents {
+	std::vector<int> component;
+	std::vector<int> offsets;
+	std::vector<int> nodes;
+
+	// Number of components
+	std::size_t size() const {
+		return offsets.size() - 1;
+	}
+
+	int size(int c) const {
+		return offsets[c + 1] - offsets[c];
+	}
+
+	// Range in nodes of the members of component @a c
+	int begin(int c) const {
+		return offsets[c];
+	}
+
+	int end(int c) const {
+		return offsets[c + 1];
+	}
+};
+
+//////////////////////////////////////////////////////////////////////
+///// HELPER FUNCTIONS ///////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+/** Pearce's algorithm over the nodes with label[i] < 0.
+ * Gives each of their components the labels @a first, @a first + 1, ...
+ * with edges going from higher to lower labels.
+ * @returns The number of components found
+ */
+inline int pearce_components_(const Adjacency& out, std::vector<int>& label,
+							  int first) {
+	int n = out.num_nodes();
+	// rank[i] is 0 until i is visited, then its visit number, lowered to
+	// the least reachable on the stack; once its component is done, it is
+	// the component's number counted down from n - 1
+	std::vector<int> rank(n, 0);
+	std::vector<char> root(n, 0);
+	std::vector<std::pair<int, int> > calls;  // (node, next entry)
+	std::vector<int> stack;
+	int index = 1;
+	int c = n - 1;
+	for(int s = 0; s < n; ++s) {
+		if( label[s] >= 0 || rank[s] != 0 )
+			continue;
+		rank[s] = index++;
+		root[s] = 1;
+		calls.push_back(std::make_pair(s, out.begin(s)));
+		while( !calls.empty() ) {
+			int v = calls.back().first;
+			int& k = calls.back().second;
+			if( k < out.end(v) ) {
+				int w = out.targets[k];
+				if( label[w] < 0 ) {
+					if( rank[w] == 0 ) {
+						// Descend; the edge is checked again on return
+						rank[w] = index++;
+						root[w] = 1;
+						calls.push_back(std::make_pair(w, out.begin(w)));
+						continue;
+					}
+					if( rank[w] < rank[v] ) {
+						rank[v] = rank[w];
+						root[v] = 0;
+					}
+				}
+				++k;
+				continue;
+			}
+			calls.pop_back();
+			if( !root[v] ) {
+				stack.push_back(v);
+				continue;
+			}
+			// v is the first visited node of a finished component
+			--index;
+			while( !stack.empty() && rank[v] <= rank[stack.back()] ) {
+				rank[stack.back()] = c;
+				stack.pop_back();
+				--index;
+			}
+			rank[v] = c--;
+		}
+	}
+	int count = n - 1 - c;
+	for(int i = 0; i < n; ++i)
+		if( label[i] < 0 )
+			label[i] = first + (n - 1 - rank[i]);
+	return count;
+}
+
+/** Moves the labels 0 ... count-1 of @a label into @a result, numbering
+ * label l as order[l], and groups the members of each component.
+ */
+inline void group_components_(std::vector<int>& label,
+							  const std::vector<int>& order,
+							  StrongComponents& result) {
+	std::size_t n = label.size();
+	std::size_t count = order.size();
+	result.component.swap(label);
+	result.offsets.assign(count + 1, 0);
+	for(std::size_t i = 0; i < n; ++i) {
+		result.component[i] = order[result.component[i]];
+		++result.offsets[result.component[i] + 1];
+	}
+	for(std::size_t c = 0; c < count; ++c)
+		result.offsets[c + 1] += result.offsets[c];
+	result.nodes.resize(n);
+	std::vector<int> fill(result.offsets.begin(), result.offsets.end() - 1);
+	for(std::size_t i = 0; i < n; ++i)
+		result.nodes[fill[result.component[i]]++] = i;
+}
+
+//////////////////////////////////////////////////////////////////////
+///// COMPONENTS /////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+/** Finds the strongly connected components of a directed graph.
+ * @param[in] out The out_adjacency() of the graph
+ */
+inline void strong_components(const Adjacency& out, StrongComponents& result) {
+	std::vector<int> label(out.num_nodes(), -1);
+	int count = pearce_components_(out, label, 0);
+	// Pearce numbers sinks first
+	std::vector<int> order(count);
+	for(int c = 0; c < count; ++c)
+		order[c] = count - 1 - c;
+	group_components_(label, order, result);
+}
+
+inline StrongComponents strong_components(const Adjacency& out) {
+	StrongComponents result;
+	strong_components(out, result);
+	return result;
+}
+
+/** Returns the DAG of the components of @a scc: component c has an edge
+ * to component d != c if some node of c has an edge to a node of d.
+ * edges[k] is the Graph edge index of one such edge.
+ * @param[in] out The adjacency @a scc was computed from
+ */
+inline Adjacency condensation(const Adjacency& out,
+							  const StrongComponents& scc) {
+	std::size_t count = scc.size();
+	// (target component, Graph edge) pairs of each component
+	std::vector<std::vector<std::pair<int, int> > > arcs(count);
+	parallel_for(0, count, [&](std::size_t c) {
+		std::vector<std::pair<int, int> >& a = arcs[c];
+		for(int m = scc.begin(c); m < scc.end(c); ++m) {
+			int u = scc.nodes[m];
+			for(int k = out.begin(u); k < out.end(u); ++k) {
+				int d = scc.component[out.targets[k]];
+				if( d != int(c) )
+					a.push_back(std::make_pair(d, out.edges[k]));
+			}
+		}
+		std::sort(a.begin(), a.end());
+		std::size_t kept = 0;
+		for(std::size_t k = 0; k < a.size(); ++k)
+			if( kept == 0 || a[k].first != a[kept - 1].first )
+				a[kept++] = a[k];
+		a.resize(kept);
+	}, 64);
+
+	Adjacency dag;
+	dag.offsets.reserve(count + 1);
+	for(std::size_t c = 0; c < count; ++c) {
+		for(std::size_t k = 0; k < arcs[c].size(); ++k) {
+			dag.targets.push_back(arcs[c][k].first);
+			dag.edges.push_back(arcs[c][k].second);
+		}
+		dag.offsets.push_back(dag.targets.size());
+	}
+	return dag;
+}
+
+/** Finds the strongly connected components of a large directed graph in
+ * parallel, by trimming and a forward-backward search from one pivot.
+ * @param[in] out The out_adjacency() of the graph
+ * @param[in] in  The in_adjacency() of the graph
+ * @param[in] trim_rounds Rounds of trimming before the pivot search
+ * @post @a result is the same as strong_components() gives, except
+ * 	possibly for the numbering of components that do not reach each other
+ */
+inline void parallel_strong_components(const Adjacency& out,
+									   const Adjacency& in,
+									   StrongComponents& result,
+									   int trim_rounds = 3) {
+	std::size_t n = out.num_nodes();
+	std::vector<int> label(n, -1);
+	std::atomic<int> count(0);
+
+	// A node with no live predecessor or no live successor is a component
+	// by itself. A round decides from the labels of the round before.
+	std::vector<char> trimmed(n, 0);
+	for(int round = 0; round < trim_rounds; ++round) {
+		std::atomic<bool> changed(false);
+		parallel_for(0, n, [&](std::size_t i) {
+			if( label[i] >= 0 )
+				return;
+			bool has_out = false;
+			bool has_in = false;
+			for(int k = out.begin(i); k < out.end(i) && !has_out; ++k)
+				has_out = label[out.targets[k]] < 0 && out.targets[k] != int(i);
+			for(int k = in.begin(i); k < in.end(i) && !has_in; ++k)
+				has_in = label[in.targets[k]] < 0 && in.targets[k] != int(i);
+			if( !has_out || !has_in ) {
+				trimmed[i] = 1;
+				changed.store(true, std::memory_order_relaxed);
+			}
+		}, 1024);
+		if( !changed )
+			break;
+		for(std::size_t i = 0; i < n; ++i) {
+			if( trimmed[i] ) {
+				trimmed[i] = 0;
+				label[i] = count++;
+			}
+		}
+	}
+
+	// Pivot: the live node with the largest in-degree times out-degree
+	int pivot = -1;
+	int64_t best = -1;
+	for(std::size_t i = 0; i < n; ++i) {
+		int64_t d = int64_t(out.degree(i)) * in.degree(i);
+		if( label[i] < 0 && d > best ) {
+			best = d;
+			pivot = i;
+		}
+	}
+	if( pivot >= 0 ) {
+		// Forward and backward reach from the pivot, through live nodes
+		Bitmap reach[2];
+		const Adjacency* adj[2] = {&out, &in};
+		for(int dir = 0; dir < 2; ++dir) {
+			Bitmap& seen = reach[dir];
+			const Adjacency& a = *adj[dir];
+			seen.reset(n);
+			seen.set_atomic(pivot);
+			std::vector<int> frontier(1, pivot);
+			std::vector<std::vector<int> > next(num_threads());
+			while( !frontier.empty() ) {
+				parallel_for_chunks(0, frontier.size(),
+						[&](std::size_t b, std::size_t e, unsigned w) {
+					for(std::size_t f = b; f < e; ++f) {
+						int u = frontier[f];
+						for(int k = a.begin(u); k < a.end(u); ++k) {
+							int v = a.targets[k];
+							if( label[v] < 0 && !seen.test(v) && seen.set_atomic(v) )
+								next[w].push_back(v);
+						}
+					}
+				}, 64);
+				frontier.clear();
+				for(std::size_t w = 0; w < next.size(); ++w) {
+					frontier.insert(frontier.end(), next[w].begin(), next[w].end());
+					next[w].clear();
+				}
+			}
+		}
+		int c = count++;
+		parallel_for(0, n, [&](std::size_t i) {
+			if( reach[0].test(i) && reach[1].test(i) )
+				label[i] = c;
+		}, 4096);
+	}
+
+	// Components among the nodes left over
+	int total = count + pearce_components_(out, label, count);
+
+	// Number the components in topological order of their condensation
+	std::vector<int> order(total);
+	for(int c = 0; c < total; ++c)
+		order[c] = c;
+	group_components_(label, order, result);
+	TopologicalOrder t = topological_sort(condensation(out, result));
+	for(int k = 0; k < total; ++k)
+		order[t.order[k]] = k;
+	std::vector<int> unsorted(result.component);
+	group_components_(unsorted, order, result);
+}
+
+inline StrongComponents parallel_strong_components(const Adjacency& out,
+												   const Adjacency& in) {
+	StrongComponents result;
+	parallel_strong_components(out, in, result);
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+///// CYCLES /////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+/** Returns one shortest cycle through the first node of each component of
+ * @a scc that has a cycle: one with more than one node or a self-loop.
+ * A cycle lists its nodes in order; the last has an edge to the first.
+ * @param[in] out The adjacency @a scc was computed from
+ */
+inline std::vector<std::vector<int> > cycles(const Adjacency& out,
+											 const StrongComponents& scc) {
+	std::vector<std::vector<int> > result;
+	std::vector<int> pred(out.num_nodes(), -1);
+	std::vector<int> queue;
+	for(std::size_t c = 0; c < scc.size(); ++c) {
+		int s = scc.nodes[scc.begin(c)];
+		// Breadth-first search inside c until an edge leads back to s
+		queue.assign(1, s);
+		pred[s] = s;
+		int last = -1;
+		for(std::size_t q = 0; q < queue.size() && last < 0; ++q) {
+			int u = queue[q];
+			for(int k = out.begin(u); k < out.end(u); ++k) {
+				int v = out.targets[k];
+				if( v == s ) {
+					last = u;
+					break;
+				}
+				if( scc.component[v] == int(c) && pred[v] < 0 ) {
+					pred[v] = u;
+					queue.push_back(v);
+				}
+			}
+		}
+		if( last >= 0 ) {
+			std::vector<int> cycle;
+			for(int v = last; v != s; v = pred[v])
+				cycle.push_back(v);
+			cycle.push_back(s);
+			std::reverse(cycle.begin(), cycle.end());
+			result.push_back(cycle);
+		}
+		for(std::size_t q = 0; q < queue.size(); ++q)
+			pred[queue[q]] = -1;
+	}
+	return result;
+}
+
+#endif
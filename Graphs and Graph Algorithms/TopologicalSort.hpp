@@ -0,0 +1,128 @@
+#ifndef TOPOLOGICAL_SORT_HPP
+#define TOPOLOGICAL_SORT_HPP
+
+/** @file TopologicalSort.hpp
+ * @brief Parallel topological sort of a directed graph by levels.
+ *
+ * Kahn's algorithm: a node is ready once every node with an edge into it
+ * is placed. Ready nodes are taken a whole level at a time. Level 0 holds
+ * the nodes without incoming edges, and level l + 1 the nodes whose last
+ * predecessor is on level l, so a node's level is the length of the
+ * longest path that ends at it. Nodes on one level do not depend on each
+ * other and can be processed in parallel.
+ *
+ * Each level is expanded in parallel: threads take chunks of the level,
+ * decrement the in-degree of each successor atomically, and keep the
+ * successors that reach zero. A level is sorted by node index so the
+ * result does not depend on the thread schedule. Nothing recurses, so
+ * long dependency chains cannot overflow the stack.
+ *
+ * @code
+ * Adjacency adj = out_adjacency(g);  // g is a directed graph
+ * TopologicalOrder t = topological_sort(adj);
+ * if( !t.acyclic() ) ...
+ * @endcode
+ */
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "Adjacency.hpp"
+#include "Parallel.hpp"
+
+/** Result of a topological sort, by node index.
+ * RI: Every edge i -> j of two sorted nodes has level[i] < level[j]
+ * RI: The nodes of level l are order[level_offsets[l]] ...
+ * 	order[level_offsets[l+1] - 1], in increasing index order
+ * RI: level[i] == -1 iff node i is on a cycle or reachable from one; such
+ * 	nodes are not in order
+ */
+struct TopologicalOrder {
+	std::vector<int> order;
+	std::vector<int> level;
+	std::vector<int> level_offsets;
+
+	// True if every node was sorted, that is, the graph has no cycle
+	bool acyclic() const {
+		return order.size() == level.size();
+	}
+
+	std::size_t num_levels() const {
+		return level_offsets.size() - 1;
+	}
+
+	// Range in order of the nodes of level @a l
+	int begin(int l) const {
+		return level_offsets[l];
+	}
+
+	int end(int l) const {
+		return level_offsets[l + 1];
+	}
+};
+
+/** Sorts the nodes of a directed graph so each comes after its
+ * predecessors.
+ * @param[in] out The out_adjacency() of the graph
+ * @param[out] result Order and levels; see TopologicalOrder
+ */
+inline void topological_sort(const Adjacency& out, TopologicalOrder& result) {
+	std::size_t n = out.num_nodes();
+	unsigned threads = num_threads();
+
+	std::unique_ptr<std::atomic<int>[]> in_degree(new std::atomic<int>[n]);
+	parallel_for(0, n, [&](std::size_t i) {
+		in_degree[i].store(0, std::memory_order_relaxed);
+	}, 4096);
+	parallel_for(0, out.size(), [&](std::size_t k) {
+		in_degree[out.targets[k]].fetch_add(1, std::memory_order_relaxed);
+	}, 4096);
+
+	result.order.clear();
+	result.order.reserve(n);
+	result.level.assign(n, -1);
+	result.level_offsets.assign(1, 0);
+	std::vector<std::vector<int> > next(threads);
+	parallel_for_chunks(0, n, [&](std::size_t b, std::size_t e, unsigned w) {
+		for(std::size_t i = b; i < e; ++i)
+			if( in_degree[i].load(std::memory_order_relaxed) == 0 )
+				next[w].push_back(i);
+	}, 4096);
+
+	for(int l = 0; ; ++l) {
+		// Append the nodes found ready to the order as level l
+		std::size_t first = result.order.size();
+		for(unsigned w = 0; w < threads; ++w) {
+			result.order.insert(result.order.end(), next[w].begin(),
+								next[w].end());
+			next[w].clear();
+		}
+		std::size_t last = result.order.size();
+		if( first == last )
+			break;
+		std::sort(result.order.begin() + first, result.order.begin() + last);
+		result.level_offsets.push_back(last);
+
+		parallel_for_chunks(first, last,
+				[&](std::size_t b, std::size_t e, unsigned w) {
+			for(std::size_t k = b; k < e; ++k) {
+				int u = result.order[k];
+				result.level[u] = l;
+				for(int j = out.begin(u); j < out.end(u); ++j) {
+					int v = out.targets[j];
+					if( in_degree[v].fetch_sub(1, std::memory_order_relaxed) == 1 )
+						next[w].push_back(v);
+				}
+			}
+		}, 256);
+	}
+}
+
+inline TopologicalOrder topological_sort(const Adjacency& out) {
+	TopologicalOrder result;
+	topological_sort(out, result);
+	return result;
+}
+
+#endif
@@ -0,0 +1,628 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+/** @file Trajectory.hpp
+ * @brief Compressed per-frame node positions of a simulation.
+ *
+ * Each frame is quantized to a grid over a bounding box and coded as
+ * differences: a keyframe codes each node against the previous node, a
+ * delta frame codes each node against itself in the previous frame. The
+ * differences are zigzag mapped and written with an adaptive Rice coder,
+ * one context per coordinate. Differences are taken between quantized
+ * values, so decoding has no drift and the error of every position is at
+ * most half a grid step.
+ *
+ * A new keyframe, with a new bounding box, starts every few frames,
+ * whenever the number of nodes changes and whenever a node leaves the
+ * current box. An index of the keyframes is appended when the file is
+ * closed; a file without one (e.g. after a crash) is indexed by scanning.
+ *
+ * File layout:
+ * 	TrajectoryFileHeader
+ * 	frames: TrajectoryFrameHeader, then payload_bytes of coded data
+ * 	index: TrajectoryIndexEntry per keyframe, then TrajectoryTrailer
+ */
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+#include "Point.hpp"
+
+struct TrajectoryFileHeader {
+	char magic[8];      //< "CS207TRJ"
+	uint32_t version;
+	uint32_t bits;      //< Quantization bits per coordinate
+};
+
+struct TrajectoryFrameHeader {
+	uint32_t magic;     //< TRAJECTORY_FRAME_MAGIC
+	uint32_t keyframe;  //< 1 for keyframes, 0 for delta frames
+	uint64_t frame;
+	double time;
+	uint64_t num_nodes;
+	uint64_t payload_bytes;
+	double lo[3];       //< Bounding box of the quantization grid
+	double hi[3];
+};
+
+struct TrajectoryIndexEntry {
+	uint64_t frame;
+	uint64_t offset;    //< File offset of the keyframe's header
+};
+
+struct TrajectoryTrailer {
+	uint64_t num_keyframes;
+	uint64_t num_frames;
+	uint64_t index_offset;
+	char magic[8];      //< "CS207IDX"
+};
+
+static const uint32_t TRAJECTORY_FRAME_MAGIC = 0x4d415246;  // "FRAM"
+
+/** Adaptive Rice coding of unsigned integers into a byte buffer.
+ * The Rice parameter k tracks the running mean of the coded values, so a
+ * value v costs about log2(mean) + 1 + v / 2^k bits. Values whose unary
+ * part would be too long are escaped and written raw.
+ */
+class RiceCoder {
+	public:
+
+	RiceCoder() : sum_(8), count_(1) {
+	}
+
+	// Returns the Rice parameter for the next value
+	unsigned k() const {
+		unsigned k = 0;
+		while( (count_ << k) < sum_ && k < 24 )
+			++k;
+		return k;
+	}
+
+	// Adds @a v to the running mean
+	void update(uint32_t v) {
+		sum_ += v;
+		if( ++count_ == 64 ) {
+			sum_ >>= 1;
+			count_ >>= 1;
+		}
+	}
+
+	// Longest unary prefix before a value is escaped
+	static const unsigned escape = 24;
+
+	private:
+	uint64_t sum_;
+	uint64_t count_;
+};
+
+// Appends bits, least significant first, to a byte vector
+class BitWriter {
+	public:
+
+	BitWriter(std::vector<unsigned char>& out) : out_(out), acc_(0), n_(0) {
+	}
+
+	// Writes the low @a n bits of @a bits, n <= 32
+	void put(uint64_t bits, unsigned n) {
+		acc_ |= (bits & ((uint64_t(1) << n) - 1)) << n_;
+		n_ += n;
+		while( n_ >= 8 ) {
+			out_.push_back((unsigned char) acc_);
+			acc_ >>= 8;
+			n_ -= 8;
+		}
+	}
+
+	void put_rice(uint32_t v, RiceCoder& coder) {
+		unsigned k = coder.k();
+		uint32_t q = v >> k;
+		if( q >= RiceCoder::escape ) {
+			put((uint64_t(1) << RiceCoder::escape) - 1, RiceCoder::escape);
+			put(v, 32);
+		} else {
+			// q ones then a zero
+			put((uint64_t(1) << q) - 1, q + 1);
+			put(v, k);
+		}
+		coder.update(v);
+	}
+
+	// Pads the last byte with zeros
+	void flush() {
+		if( n_ > 0 )
+			out_.push_back((unsigned char) acc_);
+		acc_ = 0;
+		n_ = 0;
+	}
+
+	private:
+	std::vector<unsigned char>& out_;
+	uint64_t acc_;
+	unsigned n_;
+};
+
+// Reads the bits of a BitWriter. Reads past the end return zeros.
+class BitReader {
+	public:
+
+	BitReader(const unsigned char* data, std::size_t size)
+			: p_(data), end_(data + size), acc_(0), n_(0) {
+	}
+
+	uint32_t get(unsigned n) {
+		while( n_ < n ) {
+			uint64_t byte = p_ < end_ ? *p_++ : 0;
+			acc_ |= byte << n_;
+			n_ += 8;
+		}
+		uint32_t v = (uint32_t) (acc_ & ((uint64_t(1) << n) - 1));
+		acc_ >>= n;
+		n_ -= n;
+		return v;
+	}
+
+	uint32_t get_rice(RiceCoder& coder) {
+		unsigned k = coder.k();
+		unsigned q = 0;
+		while( q < RiceCoder::escape && get(1) )
+			++q;
+		uint32_t v = q == RiceCoder::escape ? get(32) : (q << k) | get(k);
+		coder.update(v);
+		return v;
+	}
+
+	private:
+	const unsigned char* p_;
+	const unsigned char* end_;
+	uint64_t acc_;
+	unsigned n_;
+};
+
+inline uint32_t zigzag(int32_t d) {
+	return ((uint32_t) d << 1) ^ (uint32_t) (d >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v) {
+	return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+/** Encodes and decodes frames. Shared by the writer and the reader so both
+ * sides quantize and predict identically.
+ */
+class TrajectoryCodec {
+	public:
+
+	TrajectoryCodec(unsigned bits) : bits_(bits), max_q_((1u << bits) - 1) {
+	}
+
+	unsigned bits() const {
+		return bits_;
+	}
+
+	/** Codes the quantized values @a q (3 per node) of one frame.
+	 * @param[in] prev Quantized values of the previous frame for a delta
+	 * 	frame, or NULL for a keyframe.
+	 */
+	void encode(const std::vector<int32_t>& q, const std::vector<int32_t>* prev,
+				std::vector<unsigned char>& out) const {
+		out.clear();
+		BitWriter w(out);
+		RiceCoder coder[3];
+		for(std::size_t i = 0; i < q.size(); ++i) {
+			int32_t ref = prev ? (*prev)[i] : (i >= 3 ? q[i - 3] : 0);
+			w.put_rice(zigzag(q[i] - ref), coder[i % 3]);
+		}
+		w.flush();
+	}
+
+	// Inverse of encode(); @a q must hold 3 values per node
+	void decode(const unsigned char* data, std::size_t size,
+				const std::vector<int32_t>* prev, std::vector<int32_t>& q) const {
+		BitReader r(data, size);
+		RiceCoder coder[3];
+		for(std::size_t i = 0; i < q.size(); ++i) {
+			int32_t ref = prev ? (*prev)[i] : (i >= 3 ? q[i - 3] : 0);
+			q[i] = ref + unzigzag(r.get_rice(coder[i % 3]));
+		}
+	}
+
+	// Quantizes coordinate @a x of axis @a a against the box of @a h
+	int32_t quantize(const TrajectoryFrameHeader& h, int a, double x) const {
+		double s = (x - h.lo[a]) / (h.hi[a] - h.lo[a]);
+		if( !(s >= 0 && s <= 1) )
+			return -1;  // Outside the box, or not finite
+		return (int32_t) std::floor(s * max_q_ + 0.5);
+	}
+
+	double dequantize(const TrajectoryFrameHeader& h, int a, int32_t q) const {
+		return h.lo[a] + (h.hi[a] - h.lo[a]) * q / max_q_;
+	}
+
+	bool in_range(int32_t q) const {
+		return q >= 0 && q <= (int32_t) max_q_;
+	}
+
+	private:
+	unsigned bits_;
+	uint32_t max_q_;
+};
+
+/** Writes a trajectory file from a background thread.
+ *
+ * write() copies the positions into a queued frame and returns; the
+ * background thread quantizes, codes and writes the frames in order. The
+ * queue holds at most @a queue_depth frames: when it is full the frame is
+ * dropped and counted rather than stalling the simulation.
+ */
+class TrajectoryWriter {
+
+	struct Frame {
+		double time;
+		std::vector<Point> x;
+	};
+
+	public:
+
+	/** Opens @a path for writing.
+	 * @param[in] keyframe_interval Frames between forced keyframes
+	 * @param[in] bits        Quantization bits per coordinate, in [8, 24]
+	 * @param[in] queue_depth Frames that may wait for the writer thread
+	 */
+	TrajectoryWriter(const std::string& path, unsigned keyframe_interval = 64,
+					 unsigned bits = 16, std::size_t queue_depth = 8)
+			: codec_(bits), keyframe_interval_(keyframe_interval),
+			  queue_depth_(queue_depth), file_(std::fopen(path.c_str(), "wb")),
+			  num_frames_(0), dropped_(0), raw_bytes_(0), stop_(false) {
+		std::memset(&key_, 0, sizeof(key_));
+		if( file_ == NULL ) {
+			std::cerr << "trajectory: cannot open " << path << std::endl;
+			return;
+		}
+		TrajectoryFileHeader h;
+		std::memset(&h, 0, sizeof(h));
+		std::memcpy(h.magic, "CS207TRJ", 8);
+		h.version = 1;
+		h.bits = bits;
+		std::fwrite(&h, sizeof(h), 1, file_);
+		thread_ = std::thread(&TrajectoryWriter::loop_, this);
+	}
+
+	~TrajectoryWriter() {
+		close();
+	}
+
+	bool is_open() const {
+		return file_ != NULL;
+	}
+
+	/** Queues the node positions of @a g at time @a t as the next frame.
+	 * @returns false if the frame was dropped because the queue is full.
+	 */
+	template <typename G>
+	bool write(G& g, double t) {
+		if( file_ == NULL )
+			return false;
+		std::unique_lock<std::mutex> lock(mutex_);
+		if( queue_.size() >= queue_depth_ ) {
+			++dropped_;
+			return false;
+		}
+		Frame frame;
+		if( !free_.empty() ) {
+			frame.x.swap(free_.back());
+			free_.pop_back();
+		}
+		lock.unlock();
+
+		frame.time = t;
+		frame.x.resize(g.num_nodes());
+		for(auto it = g.node_begin(); it != g.node_end(); ++it) {
+			auto n = *it;
+			frame.x[n.index()] = Point(n.position());
+		}
+
+		lock.lock();
+		queue_.push_back(Frame());
+		queue_.back().time = frame.time;
+		queue_.back().x.swap(frame.x);
+		lock.unlock();
+		wake_.notify_one();
+		return true;
+	}
+
+	/** Writes the queued frames and the keyframe index and closes the file.
+	 * Prints the compression ratio and the number of dropped frames.
+	 */
+	void close() {
+		if( file_ == NULL )
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_one();
+		thread_.join();
+
+		TrajectoryTrailer trailer;
+		std::memset(&trailer, 0, sizeof(trailer));
+		trailer.index_offset = ftello(file_);
+		trailer.num_keyframes = index_.size();
+		trailer.num_frames = num_frames_;
+		std::memcpy(trailer.magic, "CS207IDX", 8);
+		if( !index_.empty() )
+			std::fwrite(&index_[0], sizeof(TrajectoryIndexEntry), index_.size(), file_);
+		std::fwrite(&trailer, sizeof(trailer), 1, file_);
+		uint64_t bytes = ftello(file_);
+		std::fclose(file_);
+		file_ = NULL;
+		std::cout << "trajectory: " << num_frames_ << " frames, " << bytes
+				  << " bytes (" << (bytes ? (double) raw_bytes_ / bytes : 0)
+				  << "x), " << dropped_ << " dropped" << std::endl;
+	}
+
+	// Returns the number of frames dropped because the queue was full
+	std::size_t dropped() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return dropped_;
+	}
+
+	private:
+
+	TrajectoryCodec codec_;
+	unsigned keyframe_interval_;
+	std::size_t queue_depth_;
+	FILE* file_;
+
+	// Owned by the writer thread until close()
+	std::vector<TrajectoryIndexEntry> index_;
+	uint64_t num_frames_;
+	TrajectoryFrameHeader key_;        // Header of the current keyframe
+	std::vector<int32_t> q_, prev_;    // Quantized frame and its predecessor
+	std::vector<unsigned char> payload_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<Frame> queue_;
+	std::vector<std::vector<Point> > free_;  // Recycled position buffers
+	std::size_t dropped_;
+	uint64_t raw_bytes_;
+	bool stop_;
+	std::thread thread_;
+
+	void loop_() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(1) {
+			wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+			if( queue_.empty() )
+				return;
+			Frame frame;
+			frame.time = queue_.front().time;
+			frame.x.swap(queue_.front().x);
+			queue_.pop_front();
+			raw_bytes_ += frame.x.size() * 3 * sizeof(double);
+			lock.unlock();
+			encode_(frame);
+			lock.lock();
+			free_.push_back(std::vector<Point>());
+			free_.back().swap(frame.x);
+		}
+	}
+
+	// Sets the box of the keyframe header @a h around @a x with a margin,
+	// so the following frames stay inside it for a while
+	static void fit_box_(TrajectoryFrameHeader& h, const std::vector<Point>& x) {
+		for(int a = 0; a < 3; ++a) {
+			h.lo[a] = x.empty() ? 0 : x[0][a];
+			h.hi[a] = h.lo[a];
+		}
+		for(std::size_t i = 0; i < x.size(); ++i) {
+			for(int a = 0; a < 3; ++a) {
+				h.lo[a] = std::min(h.lo[a], x[i][a]);
+				h.hi[a] = std::max(h.hi[a], x[i][a]);
+			}
+		}
+		for(int a = 0; a < 3; ++a) {
+			double margin = std::max(0.125 * (h.hi[a] - h.lo[a]), 1e-6);
+			h.lo[a] -= margin;
+			h.hi[a] += margin;
+		}
+	}
+
+	// Quantizes @a x against the current keyframe box into q_. Returns
+	// false if a node lies outside the box.
+	bool quantize_(const std::vector<Point>& x) {
+		q_.resize(3 * x.size());
+		bool inside = true;
+		for(std::size_t i = 0; i < x.size(); ++i) {
+			for(int a = 0; a < 3; ++a) {
+				q_[3 * i + a] = codec_.quantize(key_, a, x[i][a]);
+				inside = inside && codec_.in_range(q_[3 * i + a]);
+			}
+		}
+		return inside;
+	}
+
+	void encode_(const Frame& frame) {
+		TrajectoryFrameHeader h;
+		std::memset(&h, 0, sizeof(h));
+		h.magic = TRAJECTORY_FRAME_MAGIC;
+		h.frame = num_frames_;
+		h.time = frame.time;
+		h.num_nodes = frame.x.size();
+
+		bool key = index_.empty() ||
+				   num_frames_ - index_.back().frame >= keyframe_interval_ ||
+				   key_.num_nodes != h.num_nodes || !quantize_(frame.x);
+		if( key ) {
+			fit_box_(h, frame.x);
+			key_ = h;
+			quantize_(frame.x);
+			TrajectoryIndexEntry entry = {num_frames_, (uint64_t) ftello(file_)};
+			index_.push_back(entry);
+		}
+		h.keyframe = key;
+		std::memcpy(h.lo, key_.lo, sizeof(h.lo));
+		std::memcpy(h.hi, key_.hi, sizeof(h.hi));
+		codec_.encode(q_, key ? NULL : &prev_, payload_);
+		h.payload_bytes = payload_.size();
+		std::fwrite(&h, sizeof(h), 1, file_);
+		if( !payload_.empty() )
+			std::fwrite(&payload_[0], 1, payload_.size(), file_);
+		prev_.swap(q_);
+		++num_frames_;
+	}
+};
+
+/** Random access to the frames of a trajectory file.
+ * Reading frame f decodes forward from the last keyframe at or before f;
+ * reading frames in increasing order decodes each frame once.
+ */
+class TrajectoryReader {
+	public:
+
+	TrajectoryReader() : codec_(16), file_(NULL), num_frames_(0),
+						 current_(-1) {
+	}
+
+	~TrajectoryReader() {
+		if( file_ )
+			std::fclose(file_);
+	}
+
+	/** Opens the trajectory at @a path and loads or rebuilds its index.
+	 * @returns false, with a message on std::cerr, on failure.
+	 */
+	bool open(const std::string& path) {
+		file_ = std::fopen(path.c_str(), "rb");
+		TrajectoryFileHeader h;
+		if( file_ == NULL || std::fread(&h, sizeof(h), 1, file_) != 1 ||
+			std::memcmp(h.magic, "CS207TRJ", 8) != 0 || h.version != 1 ) {
+			std::cerr << "trajectory: " << path << " is not a trajectory" << std::endl;
+			return false;
+		}
+		codec_ = TrajectoryCodec(h.bits);
+		if( !read_index_() )
+			scan_index_();
+		return true;
+	}
+
+	std::size_t num_frames() const {
+		return num_frames_;
+	}
+
+	std::size_t num_keyframes() const {
+		return index_.size();
+	}
+
+	/** Decodes frame @a f.
+	 * @param[out] x Node positions by node index
+	 * @param[out] t Simulation time of the frame
+	 * @pre f < num_frames()
+	 */
+	bool read(std::size_t f, std::vector<Point>& x, double& t) {
+		// Start from the last keyframe unless f follows the current frame
+		// in the same run of delta frames
+		auto key = std::upper_bound(index_.begin(), index_.end(), f,
+				[](std::size_t v, const TrajectoryIndexEntry& e) { return v < e.frame; });
+		if( key == index_.begin() )
+			return false;
+		--key;
+		if( current_ < (long long) key->frame || current_ > (long long) f ) {
+			fseeko(file_, key->offset, SEEK_SET);
+			current_ = (long long) key->frame - 1;
+		}
+		while( current_ < (long long) f ) {
+			if( !next_() )
+				return false;
+		}
+		x.resize(header_.num_nodes);
+		for(std::size_t i = 0; i < x.size(); ++i)
+			for(int a = 0; a < 3; ++a)
+				x[i][a] = codec_.dequantize(header_, a, q_[3 * i + a]);
+		t = header_.time;
+		return true;
+	}
+
+	private:
+
+	TrajectoryCodec codec_;
+	FILE* file_;
+	std::vector<TrajectoryIndexEntry> index_;
+	std::size_t num_frames_;
+
+	// Last decoded frame; the file is positioned after it
+	long long current_;
+	TrajectoryFrameHeader header_;
+	std::vector<int32_t> q_, prev_;
+	std::vector<unsigned char> payload_;
+
+	// Reads the frame at the file position and decodes it into q_
+	bool next_() {
+		TrajectoryFrameHeader h;
+		if( std::fread(&h, sizeof(h), 1, file_) != 1 ||
+			h.magic != TRAJECTORY_FRAME_MAGIC )
+			return false;
+		payload_.resize(h.payload_bytes);
+		if( h.payload_bytes &&
+			std::fread(&payload_[0], 1, h.payload_bytes, file_) != h.payload_bytes )
+			return false;
+		prev_.swap(q_);
+		q_.resize(3 * h.num_nodes);
+		codec_.decode(payload_.empty() ? NULL : &payload_[0], payload_.size(),
+					  h.keyframe ? NULL : &prev_, q_);
+		header_ = h;
+		current_ = h.frame;
+		return true;
+	}
+
+	// Loads the index written by TrajectoryWriter::close()
+	bool read_index_() {
+		TrajectoryTrailer trailer;
+		if( fseeko(file_, -(off_t) sizeof(trailer), SEEK_END) != 0 ||
+			std::fread(&trailer, sizeof(trailer), 1, file_) != 1 ||
+			std::memcmp(trailer.magic, "CS207IDX", 8) != 0 )
+			return false;
+		index_.resize(trailer.num_keyframes);
+		fseeko(file_, trailer.index_offset, SEEK_SET);
+		if( !index_.empty() &&
+			std::fread(&index_[0], sizeof(TrajectoryIndexEntry), index_.size(), file_)
+			!= index_.size() )
+			return false;
+		num_frames_ = trailer.num_frames;
+		return true;
+	}
+
+	// Rebuilds the index by walking the frame headers, stopping at the
+	// first incomplete frame
+	void scan_index_() {
+		index_.clear();
+		num_frames_ = 0;
+		off_t offset = sizeof(TrajectoryFileHeader);
+		TrajectoryFrameHeader h;
+		while( fseeko(file_, offset, SEEK_SET) == 0 &&
+			   std::fread(&h, sizeof(h), 1, file_) == 1 &&
+			   h.magic == TRAJECTORY_FRAME_MAGIC ) {
+			off_t next = offset + sizeof(h) + h.payload_bytes;
+			if( fseeko(file_, next - 1, SEEK_SET) != 0 || std::fgetc(file_) == EOF )
+				break;
+			if( h.keyframe ) {
+				TrajectoryIndexEntry entry = {h.frame, (uint64_t) offset};
+				index_.push_back(entry);
+			}
+			num_frames_ = h.frame + 1;
+			offset = next;
+		}
+	}
+};
+
+#endif
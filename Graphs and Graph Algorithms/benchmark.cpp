@@ -0,0 +1,280 @@
+/**
+ * @file benchmark.cpp
+ * Timed repetitions of the graph and simulation kernels on the data meshes.
+ *
+ * @brief Usage: benchmark [-reps N] [MESH ...]
+ * Each MESH is a path without extension, e.g. data/grid3, naming MESH.nodes
+ * and either MESH.tets or MESH.tris. Without meshes, every grid, large,
+ * tub, dam and pond mesh in data/ is run.
+ *
+ * Prints one tab-separated line per mesh and kernel:
+ * 	mesh kernel reps items median_s p95_s items_per_s
+ * 	ipc cycles_per_item llc_misses_per_item branch_misses_per_item
+ * so that the output of two commits can be diffed or joined directly. The
+ * hardware counts are summed over every thread of the pool, averaged over
+ * the repetitions, and read NA where perf counters are unavailable (see
+ * PerfCounters.hpp). BFS and the mass-spring step count one item per edge
+ * visit, so their counts are per edge.
+ */
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "CS207/Util.hpp"
+
+#include "Graph.hpp"
+#include "Point.hpp"
+#include "Integrators.hpp"
+#include "Forces.hpp"
+#include "Parallel.hpp"
+#include "PerfCounters.hpp"
+
+struct BenchNodeData {
+	Point velocity;
+	double mass;
+};
+typedef Graph<BenchNodeData, double> GraphType;
+typedef GraphType::node_type Node;
+typedef GraphType::edge_type Edge;
+
+/** A mesh as read from disk: points and elements of 3 or 4 node indices. */
+struct Mesh {
+	std::vector<Point> points;
+	std::vector<std::array<int,4> > elements;
+	unsigned arity;
+};
+
+/** Reads @a name.nodes and @a name.tets, or @a name.tris if there are no
+ * tets.
+ * @returns false if the files cannot be opened.
+ */
+bool read_mesh(const std::string& name, Mesh& mesh) {
+	mesh.points.clear();
+	mesh.elements.clear();
+	std::ifstream nodes_file(name + ".nodes");
+	Point p;
+	while( CS207::getline_parsed(nodes_file, p) )
+		mesh.points.push_back(p);
+
+	std::ifstream tets_file(name + ".tets");
+	if( tets_file ) {
+		mesh.arity = 4;
+		std::array<int,4> t;
+		while( CS207::getline_parsed(tets_file, t) )
+			mesh.elements.push_back(t);
+	} else {
+		std::ifstream tris_file(name + ".tris");
+		if( !tris_file )
+			return false;
+		mesh.arity = 3;
+		std::array<int,3> t;
+		while( CS207::getline_parsed(tris_file, t) ) {
+			std::array<int,4> e = {{t[0], t[1], t[2], -1}};
+			mesh.elements.push_back(e);
+		}
+	}
+	return !mesh.points.empty();
+}
+
+/** Builds @a g from @a mesh with one edge per pair of nodes of an element,
+ * whose value is the rest length. Every node gets mass 1/N.
+ */
+void build_graph(const Mesh& mesh, GraphType& g) {
+	g.clear();
+	std::vector<Node> nodes;
+	nodes.reserve(mesh.points.size());
+	BenchNodeData data = {Point(0, 0, 0), 1.0 / mesh.points.size()};
+	for(std::size_t i = 0; i < mesh.points.size(); ++i)
+		nodes.push_back(g.add_node(mesh.points[i], data));
+	for(std::size_t k = 0; k < mesh.elements.size(); ++k) {
+		const std::array<int,4>& e = mesh.elements[k];
+		for(unsigned i = 1; i < mesh.arity; ++i) {
+			for(unsigned j = 0; j < i; ++j) {
+				Node a = nodes[e[i]];
+				Node b = nodes[e[j]];
+				g.add_edge(a, b, norm(a.position() - b.position()));
+			}
+		}
+	}
+}
+
+struct NoneFixed {
+	bool operator()(const Node&) const {
+		return false;
+	}
+};
+
+// Prints @a count / @a items, or NA if the count is unavailable
+void print_per_item(const PerfSample& d, int k, double items) {
+	std::cout << "\t";
+	if( d.valid[k] )
+		std::cout << d.value[k] / items;
+	else
+		std::cout << "NA";
+}
+
+/** Runs @a work @a reps times, calling @a setup untimed before each run,
+ * and prints the result line for @a mesh and @a kernel.
+ * @param[in] items Units of work done by one run, for the throughput.
+ */
+void run_kernel(const std::string& mesh, const std::string& kernel, int reps,
+				std::size_t items, std::function<void()> setup,
+				std::function<void()> work) {
+	static PoolPerfCounters counters;
+	std::vector<double> seconds;
+	PerfSample total;
+	for(int k = 0; k < PerfSample::num_events; ++k)
+		total.valid[k] = true;
+	for(int r = 0; r < reps; ++r) {
+		setup();
+		PerfSample before = counters.read();
+		CS207::Clock clock;
+		work();
+		seconds.push_back(clock.seconds());
+		total += counters.read() - before;
+	}
+	std::sort(seconds.begin(), seconds.end());
+	double median = seconds[(seconds.size() - 1) / 2];
+	double p95 = seconds[(std::size_t) (0.95 * (seconds.size() - 1) + 0.5)];
+	std::cout << mesh << "\t" << kernel << "\t" << reps << "\t" << items
+			  << "\t" << median << "\t" << p95 << "\t"
+			  << (median > 0 ? items / median : 0);
+	if( total.valid[PerfSample::cycles] && total.valid[PerfSample::instructions] )
+		std::cout << "\t" << total.ipc();
+	else
+		std::cout << "\tNA";
+	double all_items = double(items) * reps;
+	print_per_item(total, PerfSample::cycles, all_items);
+	print_per_item(total, PerfSample::llc_misses, all_items);
+	print_per_item(total, PerfSample::branch_misses, all_items);
+	std::cout << std::endl;
+}
+
+// Keeps the results of timed loops alive so they are not optimized away
+volatile double bench_sink;
+
+void benchmark_mesh(const std::string& name, int reps) {
+	Mesh mesh;
+	if( !read_mesh(name, mesh) ) {
+		std::cerr << "benchmark: cannot read " << name << std::endl;
+		return;
+	}
+	std::function<void()> no_setup = [] {};
+
+	run_kernel(name, "load", reps, mesh.points.size() + mesh.elements.size(),
+			   no_setup, [&] { Mesh m; read_mesh(name, m); });
+
+	GraphType g;
+	run_kernel(name, "build", reps, mesh.points.size() + mesh.elements.size(),
+			   no_setup, [&] { build_graph(mesh, g); });
+	std::size_t n = g.num_nodes();
+	std::size_t m = g.num_edges();
+
+	// Half the queries are edges of the graph, half are random node pairs
+	std::mt19937 rng(207);
+	std::vector<std::pair<Node, Node> > queries;
+	for(auto it = g.edge_begin(); it != g.edge_end() && queries.size() < m / 2; ++it) {
+		Edge e = *it;
+		queries.push_back(std::make_pair(e.node1(), e.node2()));
+	}
+	std::uniform_int_distribution<int> pick(0, n - 1);
+	while( queries.size() < m )
+		queries.push_back(std::make_pair(g.node(pick(rng)), g.node(pick(rng))));
+	run_kernel(name, "has_edge", reps, queries.size(), no_setup, [&] {
+		int found = 0;
+		for(std::size_t q = 0; q < queries.size(); ++q)
+			found += g.has_edge(queries[q].first, queries[q].second) >= 0;
+		bench_sink = found;
+	});
+
+	run_kernel(name, "iterate", reps, n + m, no_setup, [&] {
+		Point sum = Point(0, 0, 0);
+		for(auto it = g.node_begin(); it != g.node_end(); ++it)
+			sum += (*it).position();
+		double length = 0;
+		for(auto it = g.edge_begin(); it != g.edge_end(); ++it)
+			length += (*it).value();
+		bench_sink = sum.x + length;
+	});
+
+	std::vector<int> dist;
+	run_kernel(name, "bfs", reps, 2 * m, no_setup, [&] {
+		dist.assign(n, -1);
+		std::vector<int> queue(1, 0);
+		dist[0] = 0;
+		for(std::size_t head = 0; head < queue.size(); ++head) {
+			Node u = g.node(queue[head]);
+			for(auto it = u.edge_begin(); it != u.edge_end(); ++it) {
+				Edge e = *it;
+				Node v = e.node1() == u ? e.node2() : e.node1();
+				if( dist[v.index()] < 0 ) {
+					dist[v.index()] = dist[u.index()] + 1;
+					queue.push_back(v.index());
+				}
+			}
+		}
+		bench_sink = queue.size();
+	});
+
+	// Every repetition steps from the same state
+	std::vector<Point> x0;
+	for(auto it = g.node_begin(); it != g.node_end(); ++it)
+		x0.push_back((*it).position());
+	// mass_spring's problem 3 force, with its default constants
+	GravityForce<GraphType> gravity;
+	MassSpringForce<GraphType> springs;
+	DampingForce<GraphType> damping(n ? g.node(0).value().mass : 0);
+	Force<GraphType> problem3 = Force<GraphType>(&springs) +
+								Force<GraphType>(&gravity) +
+								Force<GraphType>(&damping);
+	SymplecticEuler<GraphType> integrator;
+	run_kernel(name, "mass_spring_step", reps, 2 * m, [&] {
+		for(std::size_t i = 0; i < n; ++i) {
+			g.node(i).position() = x0[i];
+			g.node(i).value().velocity = Point(0, 0, 0);
+		}
+	}, [&] { integrator(g, 0, 0.001, problem3, NoneFixed()); });
+
+	// Removes 1% of the nodes, spread over the index range
+	std::size_t removals = std::max<std::size_t>(n / 100, 1);
+	GraphType copy;
+	run_kernel(name, "remove_node", reps, removals,
+			   [&] { build_graph(mesh, copy); }, [&] {
+		for(std::size_t k = 0; k < removals; ++k)
+			copy.remove_node(copy.node((k * 7919) % copy.num_nodes()));
+	});
+}
+
+int main(int argc, char** argv) {
+	int reps = 10;
+	std::vector<std::string> meshes;
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if( arg == "-reps" && i + 1 < argc )
+			reps = std::max(std::atoi(argv[++i]), 1);
+		else
+			meshes.push_back(arg);
+	}
+	if( meshes.empty() ) {
+		const char* defaults[] = {"grid0", "grid1", "grid2", "grid3", "large",
+								  "tub2", "tub3", "tub4", "dam0", "dam3",
+								  "dam4", "pond3", "pond4"};
+		for(auto it = std::begin(defaults); it != std::end(defaults); ++it)
+			meshes.push_back(std::string("data/") + *it);
+	}
+
+	PoolPerfCounters probe;
+	std::cout << "# threads " << num_threads() << std::endl;
+	std::cout << "# perf counters " << (probe.available() ? "on" : "off")
+			  << std::endl;
+	std::cout << "mesh\tkernel\treps\titems\tmedian_s\tp95_s\titems_per_s"
+			  << "\tipc\tcycles_per_item\tllc_misses_per_item"
+			  << "\tbranch_misses_per_item" << std::endl;
+	for(std::size_t i = 0; i < meshes.size(); ++i)
+		benchmark_mesh(meshes[i], reps);
+	return 0;
+}
@@ -10,6 +10,7 @@
 
 #include <fstream>
 #include <numeric>
+#include <memory>
 
 #include "CS207/SDLViewer.hpp"
 #include "CS207/Util.hpp"
@@ -17,27 +18,59 @@
 
 #include "Graph.hpp"
 #include "Point.hpp"
+#include "SignedDistanceField.hpp"
+#include "PositionBasedDynamics.hpp"
+#include "Integrators.hpp"
+#include "Forces.hpp"
+#include "Ensemble.hpp"
+#include "Checkpoint.hpp"
+#include "Trajectory.hpp"
+#include "Profile.hpp"
 #include <list>
 
 
-// Define "value_type" of Point to be a scalar
-typedef Point::value_type scalar;
+// Scalar type of the simulation state. Build with -DMASS_SPRING_SINGLE
+// (the mass_spring_float target) to run positions, velocities and rest
+// lengths in float. Force sums are always accumulated in double Points.
+#ifdef MASS_SPRING_SINGLE
+typedef float scalar;
+#else
+typedef double scalar;
+#endif
+typedef BasicPoint<scalar> PointType;
 
 // Gravity in meters/sec^2
 static constexpr double grav = 9.81;
 
 /** Custom structure of data to store with Nodes */
 struct NodeData {
-  Point velocity;  //< Node velocity
+  PointType velocity;  //< Node velocity
   double mass;     //< Node mass
 };
 
 // HW2 #1 YOUR CODE HERE
 // Define your Graph type
-typedef Graph<NodeData, double> GraphType;
+typedef Graph<NodeData, scalar, PointType> GraphType;
 typedef typename GraphType::node_type Node;
 typedef typename GraphType::edge_type Edge;
 
+// Select the time integrator at compile time, e.g.
+//   make CXXFLAGS+=-DMASS_SPRING_INTEGRATOR=RungeKutta4
+// Any policy from Integrators.hpp can be used.
+#ifndef MASS_SPRING_INTEGRATOR
+#define MASS_SPRING_INTEGRATOR SymplecticEuler
+#endif
+typedef MASS_SPRING_INTEGRATOR<GraphType> IntegratorType;
+
+/** Predicate for the nodes at (0, 0, 0) and (1, 0, 0), which never move. */
+struct PinnedCorners {
+  template <typename NODE>
+  bool operator()(const NODE& n) const {
+    return n.position() == PointType(0, 0, 0) ||
+           n.position() == PointType(1, 0, 0);
+  }
+};
+
 /** Change a graph's nodes according to a step of the symplectic Euler
  *    method with the given node force.
  * @param[in,out] g      Graph
@@ -46,33 +79,17 @@ typedef typename GraphType::edge_type Edge;
  * @param[in]     force  Function object defining the force per node
  * @return the next time step (usually @a t + @a dt)
  *
- * @tparam G::node_value_type supports ???????? YOU CHOOSE
+ * @tparam G::node_value_type has a G::point_type velocity and a mass
  * @tparam F is a function object called as @a force(n, @a t),
  *           where n is a node of the graph and @a t is the current time.
  *           @a force must return a Point representing the force vector on Node
  *           at time @a t.
+ *
+ * The nodes at (0, 0, 0) and (1, 0, 0) are held in place.
  */
 template <typename G, typename F>
 double symp_euler_step(G& g, double t, double dt, F force) {
-  // Compute the {n+1} node positions
-  for (auto it = g.node_begin(); it != g.node_end(); ++it) {
-    auto n = *it;
-
-    // Update the position of the node according to its velocity
-    // x^{n+1} = x^{n} + v^{n} * dt
-	if( n.position() == Point(0, 0, 0) || n.position() == Point(1, 0, 0))
-		continue;
-    n.position() += n.value().velocity * dt;
-  }
-
-  // Compute the {n+1} node velocities
-  for (auto it = g.node_begin(); it != g.node_end(); ++it) {
-    auto n = *it;
-    // v^{n+1} = v^{n} + F(x^{n+1},t) * dt / m
-    n.value().velocity += force(n, t) * (dt / n.value().mass);
-  }
-
-  return t + dt;
+  return SymplecticEuler<G>()(g, t, dt, force, PinnedCorners());
 }
 
 
@@ -95,7 +112,7 @@ struct Problem1Force {
    * adjacency list and the spring length, L. 
    * @returns a Point that represents the force vector
    */
-  Point operator()(Node n, double t) {
+  PointType operator()(Node n, double t) {
 	// Initialize variables
 	(void) t;//suppress compiler warning
 	Node adjacent_node;
@@ -106,21 +123,21 @@ struct Problem1Force {
 	Point xi, xj; // xi: position of node n; xj position of adjacent node
 
 	// Calculate force on node
-  	if (n.position() == Point(0, 0, 0) || n.position() == Point(1, 0, 0)) {
-		return Point(0, 0, 0);
+  	if (PinnedCorners()(n)) {
+		return PointType(0, 0, 0);
 	}
 	total_force = Point(0, 0, -grav * n.value().mass);
-	xi = n.position();
+	xi = Point(n.position());
 	for (auto it = n.edge_begin(); it != n.edge_end(); ++it) {
 		adjacent_node = (*it).node2();
 		if( adjacent_node == n )
 			adjacent_node = (*it).node1();
-		xj = adjacent_node.position();
+		xj = Point(adjacent_node.position());
 		displacement = distance(xi, xj) - (*it).value();
 		direction = (xi - xj) / distance(xi, xj);
 		total_force += -K * displacement * direction;
 	}
-	return total_force;
+	return PointType(total_force);
   }
 };
 
@@ -157,13 +174,14 @@ class Constraint {
 class TableTop : public Rule {
 	public: 
 		virtual void apply(GraphType& g, double t) {
+			PROFILE_SCOPE("rule: TableTop");
 			(void) t;
 			for(auto it = g.node_begin(); it != g.node_end(); ++it) {
 				auto n = *it;
-				scalar dot_product = dot(n.position(), Point(0, 0, 1));
+				scalar dot_product = dot(n.position(), PointType(0, 0, 1));
 				if(dot_product < -0.75) {
-					n.position() = Point(n.position().x, n.position().y, -0.75);
-					n.value().velocity = Point(0, 0, 0);
+					n.position() = PointType(n.position().x, n.position().y, -0.75);
+					n.value().velocity = PointType(0, 0, 0);
 				}
 			}
 		}
@@ -172,23 +190,24 @@ class TableTop : public Rule {
 class Sphere : public Rule {
 	public: 
 		virtual void apply(GraphType& g, double t) {
+			PROFILE_SCOPE("rule: Sphere");
 			(void) t;
-			Point center = Point(0.5, 0.5, -0.5);
+			PointType center = PointType(0.5, 0.5, -0.5);
 			scalar radius = 0.15;
 			for(auto it = g.node_begin(); it != g.node_end(); ++it) {
 				auto n = *it;
 				scalar dist = distance(n.position(), center);
 				if(dist < radius) {
 					// Reset the position to the closest on the sphere
-					Point old_position = n.position();
-					Point direction = (n.position() / dist) - (center / dist); 
+					PointType old_position = n.position();
+					PointType direction = (n.position() / dist) - (center / dist); 
 					n.position() = center + radius * direction;
 					// Check representation invariants
 					assert( n.position() != old_position );
 					assert( distance(n.position(), center) < (radius + 0.01));
 					assert( distance(n.position(), center) > (radius - 0.01));
 					// Make the component norm to the surface 0
-					Point v = n.value().velocity;
+					PointType v = n.value().velocity;
 					n.value().velocity = (v - dot(v, direction) * direction);
 					assert( dot(n.value().velocity, direction) < 0.01 );
 				}
@@ -199,11 +218,13 @@ class Sphere : public Rule {
 class FireBall : public Rule {
 	public: 
 		virtual void apply(GraphType& g, double t) {
+			PROFILE_SCOPE("rule: FireBall");
 			(void) t;
-			Point center = Point(0.5, 0.5, -0.5);
+			PointType center = PointType(0.5, 0.5, -0.5);
 			scalar radius = 0.15;
-			for(auto it = g.node_begin(); it != g.node_end(); ++it) {
-				Node n = *it;
+			// Walk the indices backwards since removal shifts later nodes
+			for(std::size_t i = g.num_nodes(); i-- > 0; ) {
+				Node n = g.node(i);
 				scalar dist = distance(n.position(), center);
 				if(dist < radius) {
 					g.remove_node(n);
@@ -212,105 +233,73 @@ class FireBall : public Rule {
 		}
 };
 
-class Stimulus {
-	public: 
-		virtual Point apply(Node, double)=0;
-};
-
-class Force {
+/** Obstacle described by a signed distance grid.
+ * Nodes with negative distance are projected back onto the zero level set
+ * along the gradient, and the velocity component into the surface is
+ * removed. Positions are gathered into flat arrays so the grid lookups run
+ * as one pass over the node array.
+ */
+class SDFObstacle : public Rule {
 	public: 
-		typedef typename std::list<Stimulus*> f_composition;
-		f_composition forces_;
-		Force(Stimulus* s) {
-			forces_.push_front(s);
+		SDFObstacle(const SignedDistanceField& sdf) : sdf_(sdf) {
 		}
-
-		Force(f_composition composite) : forces_(composite) {
-		}
-		
-		Point operator()(Node n, double t) const {
-			Point total_force = Point(0,0,0);
-			for(auto it = forces_.begin(); it != forces_.end(); ++it) {
-				total_force = total_force + (*it)->apply(n, t);
+		virtual void apply(GraphType& g, double t) {
+			PROFILE_SCOPE("rule: SDFObstacle");
+			(void) t;
+			std::size_t n = g.num_nodes();
+			x_.resize(n); y_.resize(n); z_.resize(n);
+			phi_.resize(n); gx_.resize(n); gy_.resize(n); gz_.resize(n);
+			for(std::size_t i = 0; i < n; ++i) {
+				const PointType& p = g.node(i).position();
+				x_[i] = p.x; y_[i] = p.y; z_[i] = p.z;
 			}
-			return total_force;
-		}
-
-		Force operator+(Force f) const {
-			f_composition force_list = f.forces_;
-			for(auto it = forces_.begin(); it != forces_.end(); ++it) {
-				force_list.push_front(*it);	
+			sdf_.sample(n, x_.data(), y_.data(), z_.data(),
+						phi_.data(), gx_.data(), gy_.data(), gz_.data());
+			for(std::size_t i = 0; i < n; ++i) {
+				if( !(phi_[i] < 0) )
+					continue;
+				Point grad = Point(gx_[i], gy_[i], gz_[i]);
+				double len = norm(grad);
+				if( len == 0 )
+					continue;
+				Point direction = grad / len;
+				Node node = g.node(i);
+				// Project onto the surface and drop the inward velocity
+				node.position() -= PointType(phi_[i] * direction);
+				Point v = Point(node.value().velocity);
+				double vn = dot(v, direction);
+				if( vn < 0 )
+					node.value().velocity = PointType(v - vn * direction);
 			}
-			return Force(force_list);
-		}
-};
-
-class GravityForce : public Stimulus {
-	public:
-		virtual Point apply(Node n, double t) {
-			(void) t;
-			return Point(0, 0, -grav * n.value().mass);
-		}
-};
-
-class MassSpringForce : public Stimulus {
-  public: 
-	  virtual Point apply(Node n, double t) {
-		// Initialize variables
-		(void) t;//suppress compiler warning
-		Node adjacent_node;
-		scalar K = 100.0; // Spring constant
-		scalar displacement; // displacement from spring rest-length
-		Point direction; // direction of the force
-		Point total_force = Point(0, 0, 0);
-		Point xi, xj; // xi: position of node n; xj position of adjacent node
-
-		xi = n.position();
-		for (auto it = n.edge_begin(); it != n.edge_end(); ++it) {
-			adjacent_node = (*it).node2();
-			if( adjacent_node == n )
-				adjacent_node = (*it).node1();
-			xj = adjacent_node.position();
-			displacement = distance(xi, xj) - (*it).value();
-			direction = (xi - xj) / distance(xi, xj);
-			total_force += -K * displacement * direction;
-		}
-		return total_force;
-	  }
-};
-
-class DampingForce : public Stimulus {
-	public: 
-		scalar coeff_;
-		DampingForce(scalar coeff) : coeff_(coeff) {
-		}
-		virtual Point apply(Node n, double t) {
-			(void) t;
-			return -(n.value().velocity * coeff_);
 		}
+	private:
+		const SignedDistanceField& sdf_;
+		// Scratch arrays reused between steps
+		std::vector<SignedDistanceField::value_type> x_, y_, z_;
+		std::vector<SignedDistanceField::value_type> phi_, gx_, gy_, gz_;
 };
 
-int main(int argc, char** argv) {
-  // Check arguments
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " NODES_FILE TETS_FILE\n";
-    exit(1);
-  }
-
-  // Construct a graph
-  GraphType graph;
-
-  // Create a nodes_file from the first input argument
-  std::ifstream nodes_file(argv[1]);
-  // Interpret each line of the nodes_file as a 3D Point and add to the Graph
+/** Reads a tetrahedral mesh into the empty graph @a graph.
+ * Every tet edge becomes a spring at its initial length, and every node
+ * starts at rest with mass 1/N.
+ */
+void load_mesh(GraphType& graph, const std::string& nodes_name,
+               const std::string& tets_name) {
   std::vector<Node> nodes;
-  Point p;
-  while (CS207::getline_parsed(nodes_file, p))
-    nodes.push_back(graph.add_node(p));
+  {
+    PROFILE_SCOPE("load");
+    // Create a nodes_file from the first input argument
+    std::ifstream nodes_file(nodes_name);
+    // Interpret each line of the nodes_file as a 3D Point and add to the Graph
+    PointType p;
+    while (CS207::getline_parsed(nodes_file, p))
+      nodes.push_back(graph.add_node(p));
+  }
 
   // Create a tets_file from the second input argument
-  std::ifstream tets_file(argv[2]);
+  std::ifstream tets_file(tets_name);
   // Interpret each line of the tets_file as four ints which refer to nodes
+  PROFILE_SCOPE("build");
   std::array<int,4> t;
   while (CS207::getline_parsed(tets_file, t)) {
     for (unsigned i = 1; i < t.size(); ++i) {
@@ -332,16 +321,137 @@ int main(int argc, char** argv) {
   // Set initial conditions for your nodes, if necessary.
   for( auto it = graph.node_begin(); it != graph.node_end(); ++it ) {
   	// Initialize velocities
-	(*it).value().velocity = Point(0, 0, 0);
+	(*it).value().velocity = PointType(0, 0, 0);
 	// Initialize mass
 	(*it).value().mass = (scalar) 1 / graph.size();
 	// Initialize edge lengths
   }
+}
+
+int main(int argc, char** argv) {
+  // Separate the option flags from the file arguments
+  std::vector<std::string> args;
+  bool use_pbd = false;
+  std::string sweep_name;
+  std::string checkpoint_name;
+  std::string restart_name;
+  std::string trajectory_name;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-pbd")
+      use_pbd = true;
+    else if (arg == "-ensemble" && i + 1 < argc)
+      sweep_name = argv[++i];
+    else if (arg == "-checkpoint" && i + 1 < argc)
+      checkpoint_name = argv[++i];
+    else if (arg == "-restart" && i + 1 < argc)
+      restart_name = argv[++i];
+    else if (arg == "-trajectory" && i + 1 < argc)
+      trajectory_name = argv[++i];
+    else
+      args.push_back(arg);
+  }
+
+  // Check arguments. A restart reads the mesh from the checkpoint, so
+  // the mesh files are only needed for a fresh run.
+  std::size_t mesh_args = restart_name.empty() ? 2 : 0;
+  if (args.size() < mesh_args) {
+    std::cerr << "Usage: " << argv[0] << " [-pbd] [-ensemble SWEEP_FILE]"
+              << " [-checkpoint FILE] [-trajectory FILE]"
+              << " NODES_FILE TETS_FILE [OBSTACLE_NODES OBSTACLE_TRIS]\n"
+              << "       " << argv[0] << " [-pbd] [-checkpoint FILE]"
+              << " -restart FILE [OBSTACLE_NODES OBSTACLE_TRIS]\n"
+              << "  SWEEP_FILE lines: K DAMPING DT T_END\n";
+    exit(1);
+  }
+
+  // Construct a graph
+  GraphType graph;
+  IntegratorType integrator;
+  double t_start = 0.0;
+  std::size_t step = 0;
+
+  if (!restart_name.empty()) {
+    // Rebuild the graph, time and integrator state from the checkpoint
+    PROFILE_SCOPE("restart");
+    CS207::Clock clock;
+    CheckpointFile checkpoint;
+    if (!checkpoint.open(restart_name, sizeof(PointType)))
+      exit(1);
+    std::vector<PointType> state;
+    checkpoint.restore(graph, state);
+    const CheckpointHeader& h = checkpoint.header();
+    t_start = h.time;
+    step = h.step;
+    // State from a different integrator is dropped; stateful integrators
+    // rebuild it on their first step
+    if (std::string(h.integrator) == IntegratorType::name())
+      integrator.state().swap(state);
+    std::cout << "restart: t = " << t_start << ", step " << step
+              << ", in " << clock.seconds() << "s" << std::endl;
+  } else {
+    load_mesh(graph, args[0], args[1]);
+  }
+
   // Construct Forces/Constraints
 
+  // Voxelize the optional obstacle mesh, scaled and centered under the
+  // cloth where the Sphere obstacle sits.
+  SignedDistanceField obstacle_sdf;
+  bool has_obstacle = args.size() >= mesh_args + 2;
+  if (has_obstacle) {
+    PROFILE_SCOPE("obstacle sdf");
+    std::ifstream obstacle_nodes_file(args[mesh_args]);
+    std::ifstream obstacle_tris_file(args[mesh_args + 1]);
+    std::vector<Point> verts;
+    std::vector<std::array<int,3>> tris;
+    Point q;
+    while (CS207::getline_parsed(obstacle_nodes_file, q))
+      verts.push_back(0.25 * q + Point(0.5, 0.5, -0.5));
+    std::array<int,3> tri;
+    while (CS207::getline_parsed(obstacle_tris_file, tri))
+      tris.push_back(tri);
+    CS207::Clock clock;
+    obstacle_sdf = SignedDistanceField(verts, tris, 0.01, 0.05, 0.02);
+    std::cout << "obstacle: " << tris.size() << " triangles, "
+              << obstacle_sdf.size() << " samples in "
+              << clock.seconds() << "s" << std::endl;
+  }
+
   // Print out the stats
   std::cout << graph.num_nodes() << " " << graph.num_edges() << std::endl;
 
+  // Ensemble mode: run every parameter set of the sweep file on a shared
+  // copy of the topology, report the summaries and exit.
+  if (!sweep_name.empty()) {
+    std::ifstream sweep_file(sweep_name);
+    std::vector<EnsembleRun> runs;
+    std::array<double,4> params;
+    while (CS207::getline_parsed(sweep_file, params)) {
+      EnsembleRun run = {params[0], params[1], params[2], params[3], grav};
+      runs.push_back(run);
+    }
+    SpringTopology<PointType> topology(graph, PinnedCorners());
+    std::cout << "ensemble: " << runs.size() << " runs, "
+              << topology.bytes() << " shared bytes, "
+              << 2 * topology.num_nodes() * sizeof(PointType)
+              << " bytes per run" << std::endl;
+    CS207::Clock clock;
+    std::vector<EnsembleSummary> summaries = run_ensemble(topology, runs);
+    std::cout << "K\tdamping\tdt\tt_end\tsteps\tstable\tkinetic\t"
+              << "elastic\tmin_z\tmax_speed\tseconds" << std::endl;
+    for (auto it = summaries.begin(); it != summaries.end(); ++it) {
+      std::cout << it->run.K << "\t" << it->run.damping << "\t"
+                << it->run.dt << "\t" << it->run.t_end << "\t"
+                << it->steps << "\t" << it->stable << "\t"
+                << it->kinetic << "\t" << it->elastic << "\t"
+                << it->min_z << "\t" << it->max_speed << "\t"
+                << it->seconds << std::endl;
+    }
+    std::cout << "ensemble wall time: " << clock.seconds() << "s" << std::endl;
+    return 0;
+  }
+
   // Launch the SDLViewer
   CS207::SDLViewer viewer;
   auto node_map = viewer.empty_node_map(graph);
@@ -354,19 +464,21 @@ int main(int argc, char** argv) {
 
   // Begin the mass-spring simulation
   double dt = 0.001;
-  double t_start = 0.0;
   double t_end   = 5.0;
 
   // Construct the problem 1 force using new Force structure
 
-  GravityForce g_force;
-  MassSpringForce spring_force;
-  DampingForce damp_force ((scalar) 1 / graph.size());
-  Force gravity_f (&g_force);
-  Force spring_f (&spring_force);
-  Force damp_f (&damp_force);
-  Force problem1_f = spring_f + gravity_f;
-  Force problem3_f = spring_f + gravity_f + damp_f;
+  GravityForce<GraphType> g_force (grav);
+  MassSpringForce<GraphType> spring_force;
+  // Every node has mass 1/N of the original mesh, which survives removals
+  // and restarts where graph.size() does not
+  DampingForce<GraphType> damp_force (graph.size() ? graph.node(0).value().mass : 0);
+  typedef Force<GraphType> ForceType;
+  ForceType gravity_f (&g_force);
+  ForceType spring_f (&spring_force);
+  ForceType damp_f (&damp_force);
+  ForceType problem1_f = spring_f + gravity_f;
+  ForceType problem3_f = spring_f + gravity_f + damp_f;
 
   TableTop tt_constraint;
   Sphere s_constraint;
@@ -374,13 +486,59 @@ int main(int argc, char** argv) {
   Constraint table_top_c (&tt_constraint);
   Constraint sphere_c (&s_constraint);
   Constraint fireball_c (&fire_ball_constraint);
+  SDFObstacle sdf_constraint (obstacle_sdf);
+  Constraint obstacle_c (&sdf_constraint);
+  Constraint constraints = has_obstacle ? fireball_c + obstacle_c : fireball_c;
+
+  // The position-based solver models the springs as edge constraints, so
+  // it only takes the external forces.
+  PositionBasedDynamics<GraphType> pbd;
+  ForceType external_f = gravity_f + damp_f;
+  std::cout << "integrator: "
+            << (use_pbd ? "position-based" : IntegratorType::name())
+            << std::endl;
+
+  // Checkpoints are copied here and written by a background thread
+  const std::size_t checkpoint_every = 500;
+  CheckpointWriter checkpoint_writer;
+  std::vector<PointType> no_state;
+
+  // Every frame's positions, compressed by a background thread
+  std::unique_ptr<TrajectoryWriter> trajectory;
+  if (!trajectory_name.empty())
+    trajectory.reset(new TrajectoryWriter(trajectory_name));
 
   for (double t = t_start; t < t_end; t += dt) {
     //std::cout << "t = " << t << std::endl;
-    symp_euler_step(graph, t, dt, problem3_f);
-	fireball_c(graph, t);
+    PROFILE_SCOPE("step");
+    {
+      PROFILE_SCOPE("integrate");
+      if (use_pbd)
+        pbd.step(graph, t, dt, external_f, PinnedCorners());
+      else
+        integrator(graph, t, dt, problem3_f, PinnedCorners());
+    }
+    {
+      PROFILE_SCOPE("constraints");
+      constraints(graph, t);
+    }
+	++step;
+
+	if (!checkpoint_name.empty() && step % checkpoint_every == 0) {
+	  PROFILE_SCOPE("checkpoint");
+	  std::vector<char> image = use_pbd
+	      ? checkpoint_image(graph, t + dt, step, "position-based", no_state)
+	      : checkpoint_image(graph, t + dt, step, IntegratorType::name(),
+	                         integrator.state());
+	  checkpoint_writer.write(checkpoint_name, image);
+	}
+	if (trajectory) {
+	  PROFILE_SCOPE("trajectory");
+	  trajectory->write(graph, t + dt);
+	}
 
 	// Redraw the graph
+	PROFILE_SCOPE("render");
 	viewer.clear();
 	node_map.clear();
     // Update viewer with nodes' new positions
@@ -5,141 +5,276 @@
  * @brief Reads in two files specified on the command line.
  * First file: 3D Points (one per line) defined by three doubles
  * Second file: Tetrahedra (one per line) defined by 4 indices into the point
- * list
+ * list, or, if its name ends in .tris, triangles defined by 3 indices. On a
+ * triangle mesh, distances are geodesic distances over the surface.
  */
 
 #include <vector>
 #include <fstream>
 #include <math.h>
-#include <queue>
-#include <set>
 
 #include "CS207/SDLViewer.hpp"
 #include "CS207/Util.hpp"
 #include "CS207/Color.hpp"
 
 #include "Graph.hpp"
+#include "Adjacency.hpp"
+#include "ShortestPath.hpp"
+#include "DeltaStepping.hpp"
+#include "BFS.hpp"
+#include "PointToPoint.hpp"
+#include "ContractionHierarchy.hpp"
+#include "KdTree.hpp"
+#include "FastMarching.hpp"
+#include "DynamicShortestPath.hpp"
 
-struct MyNodeData {
-	double dist;
-	bool perm;
-	bool temp;
-};
-typedef Graph<MyNodeData, double> GraphType;
+typedef Graph<int, double> GraphType;
 typedef GraphType::node_type Node;
 typedef GraphType::edge_type Edge;
 
 /** Define custom operator to return a color object for a node */
 struct MyColorFunc {
+	const std::vector<double>& dist_;
 	double lp_;
 
-	/** Constructor */
-	MyColorFunc(double longest_path) : lp_(longest_path) {
+	/** Constructor
+	 * @param[in] dist Path length of each node by node index, negative for
+	 * 	unreachable nodes
+	 */
+	MyColorFunc(const std::vector<double>& dist, double longest_path)
+			: dist_(dist), lp_(longest_path) {
 	}
 
 	template <typename NODE>
 	// Return a color object to color the graph
 	CS207::Color operator()(const NODE& node) {
-		return CS207::Color::make_heat(node.value().dist / lp_);
+		NODE n = node;
+		double d = dist_[n.index()];
+		return CS207::Color::make_heat(d < 0 || lp_ == 0 ? 1 : d / lp_);
 	}
 };
 
-/** Comparator that compares the distance from a given point p.
- */
-struct MyComparator {
-   Point p_;
-   MyComparator(const Point& p) : p_(p) {
-   };
-
-   template <typename NODE>
-   // Return true if node1 is closer to p than node2
-   bool operator()(const NODE& node1, const NODE& node2) const {
-		double dist1 = norm(node1.position() - p_);
-		double dist2 = norm(node2.position() - p_);
-		return dist1 < dist2;
-   }
-};
-
 /** Calculate shortest path lengths in @a g from the nearest node to @a point.
- * @param[in,out] g Input graph
+ * @param[in] g Input graph
+ * @param[in] index Spatial index of the positions of @a g
  * @param[in] point Point to find the nearest node to.
- * @post Graph has modified node values indicating the minimum path length
- *           to the nearest node to @a point
- * @post Graph nodes that are unreachable to the nearest node to @a point have
- *           the value() -1.
+ * @param[in] hops If true, every edge has length 1; otherwise edges have
+ * 	their Euclidean length.
+ * @param[in] delta Bucket width of the delta-stepping search, or 0 for the
+ * 	mean edge length.
+ * @param[out] dist Minimum path length from the nearest node to @a point,
+ * 	by node index. Nodes unreachable from that node have length -1.
  * @return The maximum path length found.
  *
- * Finds the nearest node to @a point and treats that as the root node for a
- * breadth first search.
- * This sets node's value() to the length of the shortest path to
- * the root node. The root's value() is 0. Nodes unreachable from
- * the root have value() -1.
+ * Finds the nearest node to @a point and searches from it. Hop counts use
+ * the parallel direction-optimizing BFS; Euclidean lengths use parallel
+ * delta-stepping, which falls back to Dijkstra on small graphs.
+ */
+double shortest_path_lengths(GraphType& g, const KdTree<Point>& index,
+							 const Point& point, bool hops, double delta,
+							 std::vector<double>& dist) {
+	int root = index.nearest(point);
+
+	Adjacency adj = out_adjacency(g);
+	dist.assign(g.num_nodes(), -1);
+	if( hops ) {
+		DirectionOptimizingBFS bfs(adj, adj);
+		BFSResult result = bfs.run(root);
+		for(std::size_t i = 0; i < dist.size(); ++i)
+			dist[i] = result.depth[i];
+	} else {
+		std::vector<double> w = euclidean_weights(g, adj);
+		DeltaStepping<double> search(adj, w, delta);
+		ShortestPathTree<double> tree = search.run(root);
+		for(std::size_t i = 0; i < dist.size(); ++i)
+			if( tree.reached(i) )
+				dist[i] = tree.dist[i];
+	}
+	return *std::max_element(dist.begin(), dist.end());
+}
+
+/** Calculate geodesic distances over a triangle mesh from the node nearest
+ * to @a point, by fast marching.
+ * @param[in] x         Node positions of the mesh by node index
+ * @param[in] triangles Node indices of each triangle
+ * @param[out] dist Surface distance by node index, -1 for nodes not
+ * 	connected to the nearest node.
+ * @return The maximum distance found.
  */
-double shortest_path_lengths(GraphType& g, const Point& point) {
-	double longest_path = 0;
-	Node current_node;
-	Node adjacent_node;
-	Node closest_node;
-	Edge incident_edge;
-	std::set<Node> visited;
-	std::queue<Node> to_visit;
-
-	// Find closest current_node to the given point
-	auto closest = std::min_element(g.node_begin(), 
-									g.node_end(), MyComparator(point));
-	closest_node = *closest;
-	closest_node.value().dist = 0;
-	closest_node.value().perm = true;
-	closest_node.value().temp = false;
-
-	to_visit.push(closest_node);
-	while (!to_visit.empty()) {
-		// Get the next node to visit
-		current_node = to_visit.front();
-		to_visit.pop();
-		for (auto it = current_node.edge_begin(); 
-			 it != current_node.edge_end(); ++it) {
-
-			// Find the adjacent node
-			incident_edge = *it;
-			if( incident_edge.node1() == current_node )
-				adjacent_node = incident_edge.node2();
-			else 
-				adjacent_node = incident_edge.node1();
-
-			// If this node has not been visited before, push it on the 
-			// "to visit" list
-			if ( !adjacent_node.value().perm ) {
-				double dist = norm(current_node.position() - 
-											adjacent_node.position());
-				adjacent_node.value().dist = dist+current_node.value().dist;
-
-				// Determine if this is the longest path
-				if (adjacent_node.value().dist > longest_path) {
-					longest_path = adjacent_node.value().dist;
-				}
-
-				// Push the adjacent_node on the queue of "to visit" nodes
-				if( !adjacent_node.value().temp ) {
-					adjacent_node.value().temp = true;
-					to_visit.push(adjacent_node);
-				}
-			}
+double geodesic_lengths(const std::vector<Point>& x,
+						const std::vector<std::array<int,3> >& triangles,
+						const KdTree<Point>& index, const Point& point,
+						std::vector<double>& dist) {
+	FastMarching<Point> marching(x, triangles);
+	std::vector<double> T = marching.solve(std::vector<int>(1, index.nearest(point)));
+	dist.assign(x.size(), -1);
+	for(std::size_t i = 0; i < dist.size(); ++i)
+		if( T[i] != ShortestPathTree<double>::unreachable() )
+			dist[i] = T[i];
+	return *std::max_element(dist.begin(), dist.end());
+}
+
+/** Calculate the distance from every node of @a g to the nearest of
+ * @a num_seeds seed nodes spread evenly over the node indices.
+ * @param[out] dist Distance to the nearest seed by node index, -1 for
+ * 	nodes that no seed reaches.
+ * @return The maximum distance found.
+ *
+ * All seeds are searched at once by a single delta-stepping run. Prints
+ * the sizes of the smallest and largest seed regions.
+ */
+double seed_distances(GraphType& g, unsigned num_seeds, double delta,
+					  std::vector<double>& dist) {
+	std::vector<int> seeds;
+	for(unsigned k = 0; k < num_seeds && k < g.num_nodes(); ++k)
+		seeds.push_back((std::size_t) k * g.num_nodes() / num_seeds);
+
+	Adjacency adj = out_adjacency(g);
+	std::vector<double> w = euclidean_weights(g, adj);
+	DeltaStepping<double> search(adj, w, delta);
+	ShortestPathTree<double> tree;
+	std::vector<int> owner;
+	search.run(seeds, tree, owner);
+
+	dist.assign(g.num_nodes(), -1);
+	std::vector<int> region(seeds.size(), 0);
+	for(std::size_t i = 0; i < dist.size(); ++i) {
+		if( owner[i] >= 0 ) {
+			dist[i] = tree.dist[i];
+			++region[owner[i]];
 		}
-		// Mark this node as visited
-		current_node.value().perm = true;
-		current_node.value().temp = false;
 	}
-	return longest_path;
+	std::cout << seeds.size() << " seeds, regions of "
+			  << *std::min_element(region.begin(), region.end()) << " to "
+			  << *std::max_element(region.begin(), region.end()) << " nodes"
+			  << std::endl;
+	return *std::max_element(dist.begin(), dist.end());
+}
+
+
+/** Print the shortest path in @a g between the nodes nearest to @a from
+ * and @a to, found by A*.
+ * @param[in] ch_file If not empty, also query a contraction hierarchy,
+ * 	loaded from this file or built and saved to it.
+ */
+void print_path(GraphType& g, const KdTree<Point>& index, const Point& from,
+				const Point& to, const std::string& ch_file) {
+	int source = index.nearest(from);
+	int target = index.nearest(to);
+	Adjacency adj = out_adjacency(g);
+	std::vector<double> w = euclidean_weights(g, adj);
+	std::vector<Point> x = node_positions(g);
+	PointToPoint<double> search(adj, w, x);
+	PathResult<double> r = search.astar(source, target);
+	if( !r.found() ) {
+		std::cout << "No path from " << source << " to " << target << std::endl;
+		return;
+	}
+	std::cout << "Path from " << source << " to " << target << ": length "
+			  << r.length << ", " << r.path.size() << " nodes, "
+			  << r.settled << " settled" << std::endl;
+
+	if( ch_file.empty() )
+		return;
+	ContractionHierarchy<double> ch;
+	// A hierarchy saved for another mesh is rebuilt for this one
+	if( !ch.load(ch_file) || ch.num_nodes() != adj.num_nodes() ||
+		ch.graph_arcs() != adj.size() ) {
+		CS207::Clock clock;
+		ch.build(adj, w);
+		std::cout << "Built contraction hierarchy in " << clock.seconds()
+				  << "s: " << ch.num_shortcuts() << " shortcuts, core of "
+				  << ch.core_size() << " nodes" << std::endl;
+		ch.save(ch_file);
+	}
+	CHQuery<double> query(ch);
+	double d = query.distance(source, target);
+	std::cout << "Contraction hierarchy distance " << d << ", "
+			  << query.settled() << " settled" << std::endl;
+}
+
+/** Removes the nodes of @a g within @a radius of @a center and computes
+ * the Euclidean path lengths from the node nearest to @a point afterwards.
+ * @param[out] dist Path length by node index of the remaining nodes, -1
+ * 	for nodes cut off by the hole.
+ * @return The maximum path length found.
+ *
+ * The lengths are repaired after each removal by DynamicShortestPaths,
+ * which only revisits the nodes whose shortest path ran through the hole.
+ */
+double punch_hole(GraphType& g, const KdTree<Point>& index,
+				  const Point& point, const Point& center, double radius,
+				  std::vector<double>& dist) {
+	Node root = g.node(index.nearest(point));
+	DynamicShortestPaths<GraphType> paths(g, root);
+	// Take the nodes first; each removal shifts the later node indices
+	std::vector<int> inside = index.within(center, radius);
+	std::vector<Node> hole;
+	for(std::size_t k = 0; k < inside.size(); ++k)
+		if( !(g.node(inside[k]) == root) )
+			hole.push_back(g.node(inside[k]));
+
+	CS207::Clock clock;
+	std::size_t repaired = 0;
+	for(std::size_t k = 0; k < hole.size(); ++k) {
+		g.remove_node(hole[k]);
+		repaired += paths.last_repaired();
+	}
+	std::cout << "Removed " << hole.size() << " nodes in " << clock.seconds()
+			  << "s, repairing " << repaired << " path lengths" << std::endl;
+
+	dist = paths.distances();
+	for(std::size_t i = 0; i < dist.size(); ++i)
+		if( dist[i] == paths.unreachable() )
+			dist[i] = -1;
+	return *std::max_element(dist.begin(), dist.end());
 }
 
 
 
 int main(int argc, char** argv)
 {
+  // Separate the option flags from the file arguments
+  std::vector<std::string> args;
+  bool hops = false;
+  double delta = 0;
+  unsigned num_seeds = 0;
+  bool to_point = false;
+  std::string ch_file;
+  Point to;
+  double hole_radius = 0;
+  Point hole;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-hops")
+      hops = true;
+    else if (arg == "-delta" && i + 1 < argc)
+      delta = std::atof(argv[++i]);
+    else if (arg == "-seeds" && i + 1 < argc)
+      num_seeds = std::atoi(argv[++i]);
+    else if (arg == "-ch" && i + 1 < argc)
+      ch_file = argv[++i];
+    else if (arg == "-to" && i + 3 < argc) {
+      to_point = true;
+      to.x = std::atof(argv[++i]);
+      to.y = std::atof(argv[++i]);
+      to.z = std::atof(argv[++i]);
+    }
+    else if (arg == "-hole" && i + 4 < argc) {
+      hole.x = std::atof(argv[++i]);
+      hole.y = std::atof(argv[++i]);
+      hole.z = std::atof(argv[++i]);
+      hole_radius = std::atof(argv[++i]);
+    }
+    else
+      args.push_back(arg);
+  }
+
   // Check arguments
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " NODES_FILE TETS_FILE\n";
+  if (args.size() < 2) {
+    std::cerr << "Usage: " << argv[0] << " [-hops] [-delta DELTA] [-seeds N]"
+              << " [-to X Y Z [-ch FILE]] [-hole X Y Z R]"
+              << " NODES_FILE TETS_FILE|TRIS_FILE\n";
     exit(1);
   }
 
@@ -148,20 +283,34 @@ int main(int argc, char** argv)
   std::vector<GraphType::node_type> nodes;
 
   // Create a nodes_file from the first input argument
-  std::ifstream nodes_file(argv[1]);
+  std::ifstream nodes_file(args[0]);
   // Interpret each line of the nodes_file as a 3D Point and add to the Graph
   Point p;
   while (CS207::getline_parsed(nodes_file, p))
     nodes.push_back(graph.add_node(p));
 
   // Create a tets_file from the second input argument
-  std::ifstream tets_file(argv[2]);
-  // Interpret each line of the tets_file as four ints which refer to nodes
-  std::array<int,4> t;
-  while (CS207::getline_parsed(tets_file, t))
-    for (unsigned i = 1; i < t.size(); ++i)
-      for (unsigned j = 0; j < i; ++j)
-        graph.add_edge(nodes[t[i]], nodes[t[j]]);
+  std::ifstream tets_file(args[1]);
+  std::vector<std::array<int,3> > triangles;
+  bool tris = args[1].size() > 5 &&
+              args[1].compare(args[1].size() - 5, 5, ".tris") == 0;
+  if (tris) {
+    // Interpret each line as three ints which refer to nodes
+    std::array<int,3> t;
+    while (CS207::getline_parsed(tets_file, t)) {
+      triangles.push_back(t);
+      for (unsigned i = 1; i < t.size(); ++i)
+        for (unsigned j = 0; j < i; ++j)
+          graph.add_edge(nodes[t[i]], nodes[t[j]]);
+    }
+  } else {
+    // Interpret each line of the tets_file as four ints which refer to nodes
+    std::array<int,4> t;
+    while (CS207::getline_parsed(tets_file, t))
+      for (unsigned i = 1; i < t.size(); ++i)
+        for (unsigned j = 0; j < i; ++j)
+          graph.add_edge(nodes[t[i]], nodes[t[j]]);
+  }
 
   // Print out the stats
   std::cout << graph.num_nodes() << " " << graph.num_edges() << std::endl;
@@ -173,13 +322,31 @@ int main(int argc, char** argv)
   // Create empty node map
   auto node_map = viewer.empty_node_map(graph);
 
-  // Use shortest_path_lengths to set the node values to the path lengths
-  double longest_path = shortest_path_lengths(graph, Point(-1, 0, 1));
+  // Index the node positions for nearest-node lookups
+  std::vector<Point> positions = node_positions(graph);
+  KdTree<Point> index(positions);
+
+  // Use shortest_path_lengths to compute the path length of every node
+  std::vector<double> dist;
+  double longest_path;
+  if (num_seeds > 0)
+    longest_path = seed_distances(graph, num_seeds, delta, dist);
+  else if (tris && !hops)
+    longest_path = geodesic_lengths(positions, triangles, index,
+                                    Point(-1, 0, 1), dist);
+  else
+    longest_path = shortest_path_lengths(graph, index, Point(-1, 0, 1), hops,
+                                         delta, dist);
+  if (to_point)
+    print_path(graph, index, Point(-1, 0, 1), to, ch_file);
+  if (hole_radius > 0)
+    longest_path = punch_hole(graph, index, Point(-1, 0, 1), hole,
+                              hole_radius, dist);
 
   // Construct a Color functor and view with the SDLViewer
   viewer.add_nodes(graph.node_begin(), 
   				   graph.node_end(), 
-				   MyColorFunc(longest_path), 
+				   MyColorFunc(dist, longest_path), 
 				   node_map);
   viewer.add_edges(graph.edge_begin(), graph.edge_end(), node_map);
   viewer.center_view();
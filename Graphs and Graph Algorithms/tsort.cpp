@@ -1,121 +1,258 @@
 /**
  * @file tsort.cpp
- * Prints
- * A B
- * where A = number of nodes
- *       B = number of edges
- * and launches an SDLViewer to visualize the system
+ * Topologically sorts a dependency graph.
+ *
+ * @brief Reads pairs of node ids A B, one dependency each, meaning that B
+ * depends on A, and prints the ids so that every node comes after the nodes
+ * it depends on. With -levels, prints one line per level instead: the
+ * nodes of a level depend only on nodes of earlier levels.
+ *
+ * If the dependencies have cycles, prints one cycle of each strongly
+ * connected component that has one and sorts the components instead: the
+ * nodes of a component are printed together, on one line with -levels.
+ *
+ * With -online, the order is kept up to date while the dependencies are
+ * read, and a dependency that closes a cycle is reported as it is read.
+ * This only changes how the input is read: the order kept is printed in
+ * place of the plain sort, and every other option works as without it.
+ *
+ * With -run, the nodes are run as tasks on all threads by DagExecutor, and
+ * the ids are printed in the order the tasks finished.
+ *
+ * With -depends A B, prints whether A depends on B through any chain of
+ * dependencies. With -reduce, prints the dependencies of an acyclic input
+ * that no other chain implies, in the input's format. Both answer from the
+ * whole input, with or without -online.
+ *
+ * With -schedule, every node is a task of unit duration: prints each id in
+ * order with its earliest start, latest start and slack, and the critical
+ * chain of tasks that sets the total time. -online does not change the
+ * schedule.
  */
 
 #include <fstream>
-#include <set>
 #include <stdlib.h>
 #include <iterator>
+#include <algorithm>
+#include <memory>
 
-#include "CS207/SDLViewer.hpp"
 #include "CS207/Util.hpp"
 
 #include "Graph.hpp"
+#include "Adjacency.hpp"
+#include "TopologicalSort.hpp"
+#include "StronglyConnected.hpp"
+#include "DynamicTopologicalOrder.hpp"
+#include "DagExecutor.hpp"
+#include "Reachability.hpp"
+#include "CriticalPath.hpp"
 
 typedef struct node_data {
 	int id;
-	bool temp;
-	bool perm;
 } node_data;
 
 typedef Graph<node_data, int> GraphType;
 typedef GraphType::Node Node;
-typedef std::vector<int> topo_list;
-std::set<int> node_set;
-topo_list t_list;
-
-// Algorithm taken from wikipedia page on Topological Sorting
-void visit(Node& n) {
-	topo_list t;
-	if(n.value().temp) {
-		  std::cout <<"tsort: "<<"input contains a loop:" << std::endl;
-	}
-	else {
-		n.value().temp = true;
-		for(auto it = n.incoming_edge_begin(); 
-			it != n.incoming_edge_end(); ++it) {
-			Node other = (*it).node1();
-			visit(other);
-		}
-		// If this node doesn't have a permanent mark on it yet then
-		// it hasn't been place in the topological list ordering yet
-		// and we need to do that! 
-		if( !n.value().perm )
-			t_list.push_back(n.index());
-		n.value().perm = true;
-		n.value().temp = false;
-		node_set.erase(n.value().id);
-	}
-}
 
 void print_directed_edges(GraphType& g) {
 	for(auto it = g.node_begin(); it != g.node_end(); ++it) {
 		Node n = *it;
-		std::cout << "Node " << n.index() << " ... " << std::endl;
-		for(auto jt = n.incoming_edge_begin(); 
+		std::cout << "Node " << n.value().id << " ... " << std::endl;
+		for(auto jt = n.incoming_edge_begin();
 			jt != n.incoming_edge_end(); ++jt) {
 			Node other = (*jt).node1();
-			std::cout << "depends on node " << other.index() << std::endl;
+			std::cout << "depends on node " << other.value().id << std::endl;
 		}
 	}
 }
 
 int main(int argc, char** argv)
 {
+  // Separate the option flags from the file argument
+  std::vector<std::string> args;
+  bool levels = false;
+  bool verbose = false;
+  bool online = false;
+  bool run = false;
+  bool reduce = false;
+  bool schedule = false;
+  std::vector<int> query;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-levels")
+      levels = true;
+    else if (arg == "-v")
+      verbose = true;
+    else if (arg == "-online")
+      online = true;
+    else if (arg == "-run")
+      run = true;
+    else if (arg == "-reduce")
+      reduce = true;
+    else if (arg == "-schedule")
+      schedule = true;
+    else if (arg == "-depends" && i + 2 < argc) {
+      query.push_back(atoi(argv[++i]));
+      query.push_back(atoi(argv[++i]));
+    }
+    else
+      args.push_back(arg);
+  }
+
   // Check arguments
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << "NODES_FILE\n";
+  if (args.size() < 1) {
+    std::cerr << "Usage: " << argv[0] << " [-levels] [-online] [-run] [-reduce] [-schedule]"
+              << " [-depends A B] [-v] EDGES_FILE\n";
     exit(1);
   }
 
   // Construct a Graph
   GraphType graph (true);
-  // Construct a vector of nodes
-  std::vector<typename GraphType::node_type> nodes;
 
   // Create a file stream from the input file
-  std::filebuf fb;
-  fb.open(argv[1], std::ios::in);
-  std::istream edge_file(&fb);
+  std::ifstream edge_file(args[0]);
 
   // Try reading from the file stream into a vector
   auto f_start = std::istream_iterator<int> (edge_file);
   auto f_end = std::istream_iterator<int>();
-
-  // Create a vector with pairs of edges and a set with all the nodes
   std::vector<int> edge_vect(f_start, f_end);
-  node_set.insert(edge_vect.begin(), edge_vect.end());
+  assert(edge_vect.size() % 2 == 0);
 
-  // Attempt to put all the nodes into a set
-  for(auto it = node_set.begin(); it != node_set.end(); ++it) {
-  	Node n = graph.add_node(Point());
-	n.value().id = *it;
-    nodes.push_back(n);
-  }
+  // The node of each distinct id, found by the id's position in ids. A
+  // node is added when its id is first read, so ids[node.index()] does
+  // not hold; node_id maps a node index to its id.
+  std::vector<int> ids(edge_vect);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  std::vector<Node> nodes(ids.size());
+  std::vector<int> node_id;
+  node_id.reserve(ids.size());
+  auto node_of = [&](int id) {
+    Node& n = nodes[std::lower_bound(ids.begin(), ids.end(), id) - ids.begin()];
+    if (n == Node()) {
+      n = graph.add_node(Point());
+      n.value().id = id;
+      node_id.push_back(id);
+    }
+    return n;
+  };
 
-  // Add the edges to the graph
-  assert(edge_vect.size() % 2 == 0);
+  // Add the edges to the graph, keeping the order up to date if -online
+  std::unique_ptr<DynamicTopologicalOrder<GraphType> > order;
+  if (online)
+    order.reset(new DynamicTopologicalOrder<GraphType>(graph));
   for(int i = 0; i < (int) edge_vect.size(); i += 2) {
-        graph.add_edge(nodes[edge_vect[i]], nodes[edge_vect[i+1]]);
+    Node a = node_of(edge_vect[i]);
+    Node b = node_of(edge_vect[i+1]);
+    std::size_t conflicts = online ? order->num_conflicts() : 0;
+    graph.add_edge(a, b);
+    if (online && order->num_conflicts() > conflicts) {
+      const std::vector<Node>& cycle = order->last_cycle();
+      std::cerr << "tsort: " << edge_vect[i] << " " << edge_vect[i+1]
+                << " closes a loop:";
+      for(auto it = cycle.begin(); it != cycle.end(); ++it)
+        std::cerr << " " << it->value().id;
+      std::cerr << std::endl;
+    }
   }
 
-  print_directed_edges(graph);
+  if (verbose)
+    print_directed_edges(graph);
+
+  Adjacency out = out_adjacency(graph);
+  if (!query.empty()) {
+    // A depends on B if there is a path from B to A
+    auto known = [&](int id) {
+      return std::binary_search(ids.begin(), ids.end(), id);
+    };
+    bool depends = known(query[0]) && known(query[1]) &&
+                   ReachabilityIndex(out).reaches(node_of(query[1]).index(),
+                                                  node_of(query[0]).index());
+    std::cout << query[0] << (depends ? " depends on " : " does not depend on ")
+              << query[1] << std::endl;
+    return 0;
+  }
 
   // Topological sorting algorithm
-  while( !( node_set.empty() ) ) {
-  	  auto it = node_set.begin();
-	  Node n = graph.node( *it );
-	  visit(n);
+  TopologicalOrder t = topological_sort(out);
+  if (t.acyclic() && reduce) {
+    Adjacency minimal = transitive_reduction(out);
+    for(std::size_t u = 0; u < minimal.num_nodes(); ++u)
+      for(int k = minimal.begin(u); k < minimal.end(u); ++k)
+        std::cout << node_id[u] << " " << node_id[minimal.targets[k]] << std::endl;
+    std::cerr << "Kept " << minimal.size() << " of " << out.size()
+              << " dependencies" << std::endl;
+    return 0;
+  }
+  if (t.acyclic() && schedule) {
+    CS207::Clock clock;
+    Schedule<int> s = critical_path(out, in_adjacency(graph),
+                                    std::vector<int>(graph.num_nodes(), 1));
+    double seconds = clock.seconds();
+    for(auto it = s.order.order.begin(); it != s.order.order.end(); ++it)
+      std::cout << node_id[*it] << " " << s.earliest[*it] << " "
+                << s.latest[*it] << " " << s.slack(*it) << std::endl;
+    std::cerr << "Critical chain of " << s.makespan << " tasks:";
+    for(auto it = s.chain.begin(); it != s.chain.end(); ++it)
+      std::cerr << " " << node_id[*it];
+    std::cerr << std::endl << "Scheduled in " << seconds << "s" << std::endl;
+    return 0;
+  }
+  if (t.acyclic() && run) {
+    // Each task records when it finished
+    DagExecutor exec(out);
+    std::vector<int> finished(graph.num_nodes());
+    std::atomic<int> next(0);
+    CS207::Clock clock;
+    exec.run([&](int i, unsigned) { finished[next++] = i; });
+    double seconds = clock.seconds();
+    for(auto it = finished.begin(); it != finished.end(); ++it)
+      std::cout << node_id[*it] << std::endl;
+    std::cerr << "Ran " << finished.size() << " tasks on " << num_threads()
+              << " threads in " << seconds << "s, critical path "
+              << exec.critical_path() << ", " << exec.steals() << " steals"
+              << std::endl;
+    return 0;
+  }
+  if (t.acyclic()) {
+    // Print the answer
+    if (levels) {
+      for(std::size_t l = 0; l < t.num_levels(); ++l) {
+        for(int k = t.begin(l); k < t.end(l); ++k)
+          std::cout << (k == t.begin(l) ? "" : " ") << node_id[t.order[k]];
+        std::cout << std::endl;
+      }
+    } else if (online) {
+      // The order kept while reading is already a valid answer
+      std::vector<Node> sorted = order->order();
+      for(auto it = sorted.begin(); it != sorted.end(); ++it)
+        std::cout << it->value().id << std::endl;
+    } else {
+      for(auto it = t.order.begin(); it != t.order.end(); ++it)
+        std::cout << node_id[*it] << std::endl;
+    }
+    return 0;
   }
 
-  // Print the answer
-  for(auto it = t_list.begin(); it != t_list.end(); ++it) {
-  	std::cout << *it << std::endl;
+  // Report the cycles, then sort the components of the graph
+  StrongComponents scc = strong_components(out);
+  std::vector<std::vector<int> > loops = cycles(out, scc);
+  for(auto it = loops.begin(); it != loops.end(); ++it) {
+    std::cerr << "tsort: input contains a loop:";
+    for(auto jt = it->begin(); jt != it->end(); ++jt)
+      std::cerr << " " << node_id[*jt];
+    std::cerr << std::endl;
+  }
+  TopologicalOrder tc = topological_sort(condensation(out, scc));
+  for(std::size_t l = 0; l < tc.num_levels(); ++l) {
+    for(int k = tc.begin(l); k < tc.end(l); ++k) {
+      int c = tc.order[k];
+      for(int m = scc.begin(c); m < scc.end(c); ++m)
+        std::cout << (levels && (k > tc.begin(l) || m > scc.begin(c)) ? " " : "")
+                  << node_id[scc.nodes[m]] << (levels ? "" : "\n");
+    }
+    if (levels)
+      std::cout << std::endl;
   }
 
   return 0;